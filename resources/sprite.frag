@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// 0: texture * color, 1: single-channel glyph atlas with coverage as alpha
+layout(constant_id = 0) const int kMode = 0;
+
+layout(set = 0, binding = 0) uniform sampler2D spriteTexture;
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) in vec4 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec4 texel = texture(spriteTexture, fragTexCoord);
+    if (kMode == 1) {
+        outColor = vec4(fragColor.rgb, fragColor.a * texel.r);
+    } else {
+        outColor = texel * fragColor;
+    }
+}
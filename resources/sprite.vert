@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(push_constant) uniform Transform {
+    vec2 scale;
+    vec2 translate;
+} transform;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec4 inColor;
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) out vec4 fragColor;
+
+void main() {
+    // positions are in pixels, top-left origin
+    gl_Position = vec4(inPosition * transform.scale + transform.translate, 0.0, 1.0);
+    fragTexCoord = inTexCoord;
+    fragColor = inColor;
+}
@@ -0,0 +1,67 @@
+#include "deletion_queue.hpp"
+
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+    struct PendingDestroy {
+        uint64_t frame;
+        std::function<void()> destroy;
+    };
+
+    std::mutex _mutex;
+    uint64_t _currentFrame = 0;
+    // frames only move forward, so entries are sorted by frame
+    std::deque<PendingDestroy> _pending;
+
+    void run(std::vector<std::function<void()>> &destroys) {
+        // destroy outside the lock; destructors may release further objects
+        for (auto &destroy : destroys) {
+            destroy();
+        }
+    }
+}
+
+namespace deletion_queue {
+    void beginFrame(uint64_t frame) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _currentFrame = frame;
+    }
+
+    void retire(uint64_t frame) {
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            while (!_pending.empty() && _pending.front().frame <= frame) {
+                ready.push_back(std::move(_pending.front().destroy));
+                _pending.pop_front();
+            }
+        }
+        run(ready);
+    }
+
+    void defer(std::function<void()> destroy) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending.push_back({ _currentFrame, std::move(destroy) });
+    }
+
+    void flush() {
+        // keep going until destroys stop producing new entries
+        for (;;) {
+            std::vector<std::function<void()>> ready;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                for (auto &pending : _pending) {
+                    ready.push_back(std::move(pending.destroy));
+                }
+                _pending.clear();
+            }
+            if (ready.empty()) {
+                break;
+            }
+            run(ready);
+        }
+    }
+}
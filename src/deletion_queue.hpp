@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+// Defers destruction of Vulkan objects until every frame that could still
+// reference them has finished executing, so nothing needs a device idle.
+namespace deletion_queue {
+    // objects released from now on may be referenced by `frame`
+    void beginFrame(uint64_t frame);
+    // every frame up to and including `frame` has completed on the GPU
+    void retire(uint64_t frame);
+
+    void defer(std::function<void()> destroy);
+
+    // runs all pending destroys right away; the device must be idle
+    void flush();
+}
@@ -0,0 +1,202 @@
+#include "device_memory.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include "host_allocator.hpp"
+#include "vulkan_dispatch.hpp"
+
+namespace {
+    const double kLogInterval = 5.0; // seconds
+
+    const char *kCategoryNames[] = { "buffers", "images", "attachments", "staging" };
+    static_assert(sizeof(kCategoryNames) / sizeof(kCategoryNames[0]) == (size_t)device_memory::Category::Count, "missing category name");
+
+    struct Allocation {
+        VkDeviceSize size;
+        uint32_t heapIndex;
+        device_memory::Category category;
+    };
+
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties _memoryProperties = {};
+    PFN_vkGetPhysicalDeviceMemoryProperties2KHR _getMemoryProperties2 = nullptr;
+
+    std::atomic<VkDeviceSize> _tracked[VK_MAX_MEMORY_HEAPS][(size_t)device_memory::Category::Count];
+
+    std::mutex _allocationsMutex;
+    std::unordered_map<VkDeviceMemory, Allocation> _allocations;
+
+    double _lastLogTime = 0.0;
+
+    std::string formatBytes(VkDeviceSize bytes) {
+        const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+        double value = (double)bytes;
+        int unit = 0;
+        while (value >= 1024.0 && unit < 4) {
+            value /= 1024.0;
+            ++unit;
+        }
+        std::ostringstream stream;
+        stream << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << value << " " << units[unit];
+        return stream.str();
+    }
+}
+
+namespace device_memory {
+    void initialize(VkPhysicalDevice physicalDevice, bool budgetSupported) {
+        _physicalDevice = physicalDevice;
+        dispatch::instance.vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &_memoryProperties);
+
+        // budget queries need the properties2 entry point
+        _getMemoryProperties2 = nullptr;
+        if (budgetSupported) {
+            _getMemoryProperties2 = dispatch::instance.vkGetPhysicalDeviceMemoryProperties2KHR;
+        }
+
+        for (auto &heap : _tracked) {
+            for (auto &counter : heap) {
+                counter = 0;
+            }
+        }
+        _lastLogTime = 0.0;
+
+        std::cout << "memory budget " << (_getMemoryProperties2 != nullptr ? "from VK_EXT_memory_budget" : "from heap sizes") << std::endl;
+        logUsage();
+        std::cout << std::endl;
+    }
+
+    void shutdown() {
+        std::lock_guard<std::mutex> lock(_allocationsMutex);
+        if (!_allocations.empty()) {
+            std::cerr << "[memory] " << _allocations.size() << " allocations leaked" << std::endl;
+        }
+        _allocations.clear();
+        _getMemoryProperties2 = nullptr;
+        _physicalDevice = VK_NULL_HANDLE;
+    }
+
+    uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) {
+        uint32_t fallback = std::numeric_limits<uint32_t>::max();
+        for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; ++i) {
+            if ((typeBits & (1u << i)) == 0) {
+                continue;
+            }
+            VkMemoryPropertyFlags flags = _memoryProperties.memoryTypes[i].propertyFlags;
+            if ((flags & required) != required) {
+                continue;
+            }
+            if ((flags & preferred) == preferred) {
+                return i;
+            }
+            if (fallback == std::numeric_limits<uint32_t>::max()) {
+                fallback = i;
+            }
+        }
+        return fallback;
+    }
+
+    const VkMemoryType& memoryType(uint32_t typeIndex) {
+        assert(typeIndex < _memoryProperties.memoryTypeCount);
+        return _memoryProperties.memoryTypes[typeIndex];
+    }
+
+    VkResult allocate(VkDevice device, const VkMemoryAllocateInfo &allocateInfo, Category category, VkDeviceMemory *memory) {
+        VkResult result = dispatch::device.vkAllocateMemory(device, &allocateInfo, host_allocator::callbacks(), memory);
+        if (result != VK_SUCCESS) {
+            std::cerr << "[memory] failed to allocate " << formatBytes(allocateInfo.allocationSize)
+                      << " for " << kCategoryNames[(size_t)category] << ": " << result << std::endl;
+            return result;
+        }
+
+        uint32_t heapIndex = memoryType(allocateInfo.memoryTypeIndex).heapIndex;
+        _tracked[heapIndex][(size_t)category] += allocateInfo.allocationSize;
+
+        std::lock_guard<std::mutex> lock(_allocationsMutex);
+        _allocations[*memory] = { allocateInfo.allocationSize, heapIndex, category };
+        return result;
+    }
+
+    void free(VkDevice device, VkDeviceMemory memory) {
+        if (memory == VK_NULL_HANDLE) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_allocationsMutex);
+            auto it = _allocations.find(memory);
+            assert(it != _allocations.end());
+            _tracked[it->second.heapIndex][(size_t)it->second.category] -= it->second.size;
+            _allocations.erase(it);
+        }
+        dispatch::device.vkFreeMemory(device, memory, host_allocator::callbacks());
+    }
+
+    std::vector<HeapUsage> heapUsage() {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        if (_getMemoryProperties2 != nullptr) {
+            VkPhysicalDeviceMemoryProperties2KHR properties = {};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            properties.pNext = &budgetProperties;
+            _getMemoryProperties2(_physicalDevice, &properties);
+        }
+
+        std::vector<HeapUsage> heaps(_memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < _memoryProperties.memoryHeapCount; ++i) {
+            HeapUsage &heap = heaps[i];
+            heap.size = _memoryProperties.memoryHeaps[i].size;
+            heap.deviceLocal = (_memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+            VkDeviceSize trackedTotal = 0;
+            for (size_t c = 0; c < (size_t)Category::Count; ++c) {
+                heap.tracked[c] = _tracked[i][c];
+                trackedTotal += heap.tracked[c];
+            }
+
+            if (_getMemoryProperties2 != nullptr) {
+                heap.budget = budgetProperties.heapBudget[i];
+                heap.usage = budgetProperties.heapUsage[i];
+            } else {
+                heap.budget = heap.size;
+                heap.usage = trackedTotal;
+            }
+        }
+        return heaps;
+    }
+
+    VkDeviceSize headroom(uint32_t heapIndex) {
+        std::vector<HeapUsage> heaps = heapUsage();
+        assert(heapIndex < heaps.size());
+        const HeapUsage &heap = heaps[heapIndex];
+        return heap.usage < heap.budget ? heap.budget - heap.usage : 0;
+    }
+
+    void logUsage() {
+        std::vector<HeapUsage> heaps = heapUsage();
+        for (size_t i = 0; i < heaps.size(); ++i) {
+            const HeapUsage &heap = heaps[i];
+            std::cout << "[memory] heap " << i << (heap.deviceLocal ? " (device local)" : "")
+                      << ": " << formatBytes(heap.usage) << " / " << formatBytes(heap.budget) << " budget"
+                      << ", " << formatBytes(heap.size) << " total (";
+            for (size_t c = 0; c < (size_t)Category::Count; ++c) {
+                std::cout << (c > 0 ? ", " : "") << kCategoryNames[c] << " " << formatBytes(heap.tracked[c]);
+            }
+            std::cout << ")" << std::endl;
+        }
+    }
+
+    void logPeriodically(double time) {
+        if (time - _lastLogTime < kLogInterval) {
+            return;
+        }
+        _lastLogTime = time;
+        logUsage();
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include "include_vulkan.hpp"
+
+// Every VkDeviceMemory allocation goes through here so usage can be tracked
+// per heap and per category, and compared against the driver's budget.
+namespace device_memory {
+    enum class Category {
+        Buffers,
+        Images,
+        Attachments,
+        Staging,
+        Count
+    };
+
+    struct HeapUsage {
+        VkDeviceSize size = 0;
+        // VK_EXT_memory_budget when available, otherwise the full heap size
+        VkDeviceSize budget = 0;
+        // process-wide usage reported by the driver, otherwise our tracked total
+        VkDeviceSize usage = 0;
+        VkDeviceSize tracked[(size_t)Category::Count] = {};
+        bool deviceLocal = false;
+    };
+
+    void initialize(VkPhysicalDevice physicalDevice, bool budgetSupported);
+    void shutdown();
+
+    // returns UINT32_MAX when no memory type has the required properties
+    uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0);
+    const VkMemoryType& memoryType(uint32_t typeIndex);
+
+    VkResult allocate(VkDevice device, const VkMemoryAllocateInfo &allocateInfo, Category category, VkDeviceMemory *memory);
+    void free(VkDevice device, VkDeviceMemory memory);
+
+    std::vector<HeapUsage> heapUsage();
+    // bytes left before the heap exceeds its budget; 0 when already over
+    VkDeviceSize headroom(uint32_t heapIndex);
+
+    void logUsage();
+    // logs at most once per interval, driven by the frame clock
+    void logPeriodically(double time);
+}
@@ -0,0 +1,497 @@
+#include "frame_capture.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "device_memory.hpp"
+#include "host_allocator.hpp"
+#include "vulkan_dispatch.hpp"
+#include "vulkan_handles.hpp"
+
+namespace {
+    // enough for every frame in flight plus a couple being encoded
+    const size_t kSlotCount = 4;
+
+    enum class SlotState {
+        Free,
+        InFlight,
+        Encoding
+    };
+
+    struct Slot {
+        handles::Buffer buffer;
+        handles::DeviceMemory memory;
+        const uint8_t *mapped = nullptr;
+        bool coherent = false;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        uint64_t frame = 0;
+        std::atomic<SlotState> state { SlotState::Free };
+    };
+
+    frame_capture::Settings _settings;
+
+    VkDevice _device = VK_NULL_HANDLE;
+    VkExtent2D _extent = {};
+    bool _bgra = false;
+    VkDeviceSize _frameSize = 0;
+    handles::CommandPool _commandPool;
+    Slot _slots[kSlotCount];
+    size_t _nextSlot = 0;
+    uint64_t _capturedFrames = 0;
+    uint64_t _droppedFrames = 0;
+    // newest frame recordCopy() was asked for, whether or not it was copied
+    uint64_t _lastRequestedFrame = 0;
+
+    std::thread _encoder;
+    std::mutex _encoderMutex;
+    std::condition_variable _encoderCondition;
+    std::deque<Slot *> _encoderQueue;
+    bool _encoderRunning = false;
+    FILE *_pipe = nullptr;
+
+    // encoder thread only: the stream must hold one frame per frame index, so
+    // skipped frames are filled in with a repeat of the last one piped
+    std::vector<uint8_t> _lastPipedPixels;
+    uint64_t _lastPipedFrame = 0;
+}
+
+namespace encode {
+    void rgbRows(const Slot &slot, std::vector<uint8_t> &out, bool filterBytes) {
+        const uint32_t width = _extent.width;
+        const uint32_t height = _extent.height;
+        out.resize((size_t)height * (width * 3 + (filterBytes ? 1 : 0)));
+        uint8_t *dst = out.data();
+        const uint8_t *src = slot.mapped;
+        const int r = _bgra ? 2 : 0;
+        const int b = _bgra ? 0 : 2;
+        for (uint32_t y = 0; y < height; ++y) {
+            if (filterBytes) {
+                *dst++ = 0; // png filter: none
+            }
+            for (uint32_t x = 0; x < width; ++x, src += 4) {
+                *dst++ = src[r];
+                *dst++ = src[1];
+                *dst++ = src[b];
+            }
+        }
+    }
+
+    uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size) {
+        static uint32_t table[256];
+        static bool initialized = false;
+        if (!initialized) {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                table[i] = c;
+            }
+            initialized = true;
+        }
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    uint32_t adler32(const uint8_t *data, size_t size) {
+        const uint32_t kMod = 65521;
+        uint32_t a = 1, b = 0;
+        while (size > 0) {
+            // largest run that cannot overflow 32 bits before the modulo
+            size_t run = std::min<size_t>(size, 5552);
+            size -= run;
+            while (run-- > 0) {
+                a += *data++;
+                b += a;
+            }
+            a %= kMod;
+            b %= kMod;
+        }
+        return (b << 16) | a;
+    }
+
+    void putBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+        out.push_back((value >> 24) & 0xFF);
+        out.push_back((value >> 16) & 0xFF);
+        out.push_back((value >> 8) & 0xFF);
+        out.push_back(value & 0xFF);
+    }
+
+    void putChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t size) {
+        putBigEndian(out, (uint32_t)size);
+        size_t typeOffset = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data, data + size);
+        putBigEndian(out, crc32(0, out.data() + typeOffset, size + 4));
+    }
+
+    // uncompressed (stored) deflate keeps encoding cheap enough for full frame rate
+    std::vector<uint8_t> png(const Slot &slot) {
+        std::vector<uint8_t> rows;
+        rgbRows(slot, rows, true);
+
+        std::vector<uint8_t> zlib;
+        const size_t kMaxBlock = 65535;
+        zlib.reserve(rows.size() + (rows.size() / kMaxBlock + 1) * 5 + 6);
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+        for (size_t offset = 0; offset < rows.size(); offset += kMaxBlock) {
+            const size_t length = std::min(kMaxBlock, rows.size() - offset);
+            const bool last = offset + length == rows.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(length & 0xFF);
+            zlib.push_back((length >> 8) & 0xFF);
+            zlib.push_back(~length & 0xFF);
+            zlib.push_back((~length >> 8) & 0xFF);
+            zlib.insert(zlib.end(), rows.begin() + offset, rows.begin() + offset + length);
+        }
+        putBigEndian(zlib, adler32(rows.data(), rows.size()));
+
+        std::vector<uint8_t> out = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        std::vector<uint8_t> header;
+        putBigEndian(header, _extent.width);
+        putBigEndian(header, _extent.height);
+        header.push_back(8); // bit depth
+        header.push_back(2); // truecolor
+        header.push_back(0); // deflate
+        header.push_back(0); // adaptive filtering
+        header.push_back(0); // no interlace
+        putChunk(out, "IHDR", header.data(), header.size());
+        putChunk(out, "IDAT", zlib.data(), zlib.size());
+        putChunk(out, "IEND", nullptr, 0);
+        return out;
+    }
+
+    void toFile(const Slot &slot) {
+        const char *extension = _settings.format == frame_capture::Format::Png ? "png" :
+                                _settings.format == frame_capture::Format::Ppm ? "ppm" : "raw";
+        std::ostringstream path;
+        path << _settings.directory << "/frame_" << std::setw(6) << std::setfill('0') << slot.frame << "." << extension;
+
+        FILE *file = fopen(path.str().c_str(), "wb");
+        if (file == nullptr) {
+            std::cerr << "[capture] can't open " << path.str() << std::endl;
+            return;
+        }
+
+        switch (_settings.format) {
+            case frame_capture::Format::Raw:
+                fwrite(slot.mapped, 1, (size_t)_frameSize, file);
+                break;
+            case frame_capture::Format::Ppm: {
+                std::vector<uint8_t> rows;
+                rgbRows(slot, rows, false);
+                fprintf(file, "P6\n%u %u\n255\n", _extent.width, _extent.height);
+                fwrite(rows.data(), 1, rows.size(), file);
+                break;
+            }
+            case frame_capture::Format::Png: {
+                std::vector<uint8_t> bytes = png(slot);
+                fwrite(bytes.data(), 1, bytes.size(), file);
+                break;
+            }
+        }
+        fclose(file);
+    }
+
+    void toPipe(const Slot &slot) {
+        const uint8_t *fill = _lastPipedPixels.empty() ? slot.mapped : _lastPipedPixels.data();
+        for (uint64_t frame = _lastPipedFrame + 1; frame < slot.frame; ++frame) {
+            fwrite(fill, 1, (size_t)_frameSize, _pipe);
+        }
+        fwrite(slot.mapped, 1, (size_t)_frameSize, _pipe);
+        _lastPipedPixels.assign(slot.mapped, slot.mapped + _frameSize);
+        _lastPipedFrame = slot.frame;
+    }
+
+    void encoderLoop() {
+        for (;;) {
+            Slot *slot = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(_encoderMutex);
+                _encoderCondition.wait(lock, [] { return !_encoderQueue.empty() || !_encoderRunning; });
+                if (_encoderQueue.empty()) {
+                    return;
+                }
+                slot = _encoderQueue.front();
+                _encoderQueue.pop_front();
+            }
+
+            if (_pipe != nullptr) {
+                toPipe(*slot);
+            } else {
+                toFile(*slot);
+            }
+            slot->state.store(SlotState::Free, std::memory_order_release);
+        }
+    }
+}
+
+namespace frame_capture {
+    void configure(const Settings &settings) {
+        _settings = settings;
+    }
+
+    bool enabled() {
+        return _settings.enabled;
+    }
+
+    void initialize(VkDevice device, uint32_t queueFamilyIndex, VkExtent2D extent, VkFormat format) {
+        if (!_settings.enabled) {
+            return;
+        }
+        assert(format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_R8G8B8A8_UNORM);
+
+        _device = device;
+        _extent = extent;
+        _bgra = format == VK_FORMAT_B8G8R8A8_UNORM;
+        _frameSize = (VkDeviceSize)extent.width * extent.height * 4;
+
+        {
+            VkCommandPoolCreateInfo poolInfo = {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.queueFamilyIndex = queueFamilyIndex;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+            VkCommandPool commandPool;
+            VkResult result = dispatch::device.vkCreateCommandPool(_device, &poolInfo, host_allocator::callbacks(), &commandPool);
+            assert(result == VK_SUCCESS);
+            _commandPool = handles::CommandPool(_device, commandPool);
+        }
+
+        for (Slot &slot : _slots) {
+            {
+                VkBufferCreateInfo bufferInfo = {};
+                bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                bufferInfo.size = _frameSize;
+                bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+                bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+                VkBuffer buffer;
+                VkResult result = dispatch::device.vkCreateBuffer(_device, &bufferInfo, host_allocator::callbacks(), &buffer);
+                assert(result == VK_SUCCESS);
+                slot.buffer = handles::Buffer(_device, buffer);
+            }
+
+            {
+                VkMemoryRequirements requirements;
+                dispatch::device.vkGetBufferMemoryRequirements(_device, slot.buffer.get(), &requirements);
+
+                // cached memory makes the CPU reads fast; coherency is handled by invalidating
+                VkMemoryAllocateInfo allocInfo = {};
+                allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+                allocInfo.allocationSize = requirements.size;
+                allocInfo.memoryTypeIndex = device_memory::findMemoryType(requirements.memoryTypeBits,
+                                                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                                                          VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+                assert(allocInfo.memoryTypeIndex != std::numeric_limits<uint32_t>::max());
+
+                VkDeviceMemory memory;
+                VkResult result = device_memory::allocate(_device, allocInfo, device_memory::Category::Staging, &memory);
+                assert(result == VK_SUCCESS);
+                slot.memory = handles::DeviceMemory(_device, memory);
+                slot.coherent = (device_memory::memoryType(allocInfo.memoryTypeIndex).propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+                result = dispatch::device.vkBindBufferMemory(_device, slot.buffer.get(), slot.memory.get(), 0);
+                assert(result == VK_SUCCESS);
+
+                void *mapped = nullptr;
+                result = dispatch::device.vkMapMemory(_device, slot.memory.get(), 0, VK_WHOLE_SIZE, 0, &mapped);
+                assert(result == VK_SUCCESS);
+                slot.mapped = (const uint8_t *)mapped;
+            }
+
+            {
+                VkCommandBufferAllocateInfo allocInfo = {};
+                allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocInfo.commandPool = _commandPool.get();
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+                allocInfo.commandBufferCount = 1;
+
+                VkResult result = dispatch::device.vkAllocateCommandBuffers(_device, &allocInfo, &slot.commandBuffer);
+                assert(result == VK_SUCCESS);
+            }
+
+            slot.state = SlotState::Free;
+        }
+
+        if (!_settings.pipeCommand.empty()) {
+            _pipe = popen(_settings.pipeCommand.c_str(), "w");
+            assert(_pipe != nullptr);
+            std::cout << "[capture] streaming " << extent.width << "x" << extent.height << " "
+                      << (_bgra ? "bgra" : "rgba") << " frames to: " << _settings.pipeCommand << std::endl;
+        } else {
+            std::cout << "[capture] writing frames to " << _settings.directory << std::endl;
+        }
+
+        _nextSlot = 0;
+        _capturedFrames = 0;
+        _droppedFrames = 0;
+        _lastRequestedFrame = 0;
+        _lastPipedPixels.clear();
+        _lastPipedFrame = 0;
+        _encoderRunning = true;
+        _encoder = std::thread(encode::encoderLoop);
+    }
+
+    void shutdown() {
+        if (!_settings.enabled || _device == VK_NULL_HANDLE) {
+            return;
+        }
+
+        // the device is idle by now; everything in flight can be encoded
+        collect(std::numeric_limits<uint64_t>::max());
+        {
+            std::lock_guard<std::mutex> lock(_encoderMutex);
+            _encoderRunning = false;
+        }
+        _encoderCondition.notify_one();
+        _encoder.join();
+
+        if (_pipe != nullptr) {
+            // frames skipped after the last copy still get their place in the stream
+            if (!_lastPipedPixels.empty()) {
+                for (uint64_t frame = _lastPipedFrame + 1; frame <= _lastRequestedFrame; ++frame) {
+                    fwrite(_lastPipedPixels.data(), 1, (size_t)_frameSize, _pipe);
+                }
+            }
+            pclose(_pipe);
+            _pipe = nullptr;
+        }
+
+        for (Slot &slot : _slots) {
+            dispatch::device.vkUnmapMemory(_device, slot.memory.get());
+            slot.mapped = nullptr;
+            slot.commandBuffer = VK_NULL_HANDLE;
+            slot.buffer.reset();
+            slot.memory.reset();
+        }
+        _commandPool.reset();
+        _device = VK_NULL_HANDLE;
+
+        std::cout << "[capture] " << _capturedFrames << " frames captured, " << _droppedFrames << " skipped" << std::endl;
+    }
+
+    VkCommandBuffer recordCopy(VkImage image, uint64_t frame) {
+        _lastRequestedFrame = frame;
+        Slot &slot = _slots[_nextSlot];
+        if (slot.state.load(std::memory_order_acquire) != SlotState::Free) {
+            ++_droppedFrames;
+            return VK_NULL_HANDLE;
+        }
+        _nextSlot = (_nextSlot + 1) % kSlotCount;
+
+        VkCommandBuffer commandBuffer = slot.commandBuffer;
+        {
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+            VkResult result = dispatch::device.vkBeginCommandBuffer(commandBuffer, &beginInfo);
+            assert(result == VK_SUCCESS);
+        }
+
+        VkImageMemoryBarrier imageBarrier = {};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = image;
+        imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        imageBarrier.subresourceRange.levelCount = 1;
+        imageBarrier.subresourceRange.layerCount = 1;
+
+        imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        dispatch::device.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                              0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0; // tightly packed
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = { _extent.width, _extent.height, 1 };
+        dispatch::device.vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.get(), 1, &region);
+
+        imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        imageBarrier.dstAccessMask = 0;
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        VkBufferMemoryBarrier bufferBarrier = {};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = slot.buffer.get();
+        bufferBarrier.offset = 0;
+        bufferBarrier.size = VK_WHOLE_SIZE;
+
+        dispatch::device.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                                              0, nullptr, 0, nullptr, 1, &imageBarrier);
+        dispatch::device.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                                              0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+        {
+            VkResult result = dispatch::device.vkEndCommandBuffer(commandBuffer);
+            assert(result == VK_SUCCESS);
+        }
+
+        slot.frame = frame;
+        slot.state.store(SlotState::InFlight, std::memory_order_release);
+        return commandBuffer;
+    }
+
+    void collect(uint64_t frame) {
+        if (!_settings.enabled) {
+            return;
+        }
+
+        // slots are handed out round-robin, so walking from the oldest keeps frames in order
+        std::vector<Slot *> ready;
+        for (size_t i = 0; i < kSlotCount; ++i) {
+            Slot &slot = _slots[(_nextSlot + i) % kSlotCount];
+            if (slot.state.load(std::memory_order_acquire) != SlotState::InFlight || slot.frame > frame) {
+                continue;
+            }
+            if (!slot.coherent) {
+                VkMappedMemoryRange range = {};
+                range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+                range.memory = slot.memory.get();
+                range.offset = 0;
+                range.size = VK_WHOLE_SIZE;
+                dispatch::device.vkInvalidateMappedMemoryRanges(_device, 1, &range);
+            }
+            slot.state.store(SlotState::Encoding, std::memory_order_release);
+            ready.push_back(&slot);
+        }
+        if (ready.empty()) {
+            return;
+        }
+
+        _capturedFrames += ready.size();
+        {
+            std::lock_guard<std::mutex> lock(_encoderMutex);
+            _encoderQueue.insert(_encoderQueue.end(), ready.begin(), ready.end());
+        }
+        _encoderCondition.notify_one();
+    }
+}
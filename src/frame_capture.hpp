@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+
+#include "include_vulkan.hpp"
+
+// Copies presented swapchain images into a ring of host-visible readback
+// buffers. Copies are picked up once their frame retires and are encoded on
+// a worker thread, so capturing never blocks the render loop; when every
+// buffer is busy the frame is skipped instead. Skipped frames leave a gap in
+// the file numbering, and are filled with a repeat of the previous frame in a
+// piped stream so its playback keeps the frame rate.
+namespace frame_capture {
+    enum class Format {
+        Raw,
+        Ppm,
+        Png
+    };
+
+    struct Settings {
+        bool enabled = false;
+        Format format = Format::Ppm;
+        // one file per frame is written here...
+        std::string directory = ".";
+        // ...unless raw frames are streamed to this command's stdin (e.g. ffmpeg)
+        std::string pipeCommand;
+    };
+
+    // must be called before the swapchain is created
+    void configure(const Settings &settings);
+    bool enabled();
+
+    void initialize(VkDevice device, uint32_t queueFamilyIndex, VkExtent2D extent, VkFormat format);
+    void shutdown();
+
+    // `image` must be in PRESENT_SRC layout once previously submitted work completes;
+    // returns the command buffer to submit after the frame's own commands, or
+    // VK_NULL_HANDLE if no readback buffer is free
+    VkCommandBuffer recordCopy(VkImage image, uint64_t frame);
+
+    // hands the copies of every frame up to and including `frame` to the encoder
+    void collect(uint64_t frame);
+}
@@ -0,0 +1,168 @@
+#include "frame_stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // window used for percentiles; totals cover the whole run
+    const size_t kFrameWindow = 1024;
+
+    std::mutex _mutex;
+    Clock::time_point _processStart;
+    Clock::time_point _lastPresent;
+    bool _presentedAny = false;
+    double _startupMs = 0.0;
+    uint64_t _frameCount = 0;
+    double _totalMs = 0.0;
+    double _frameTimesMs[kFrameWindow];
+
+    struct PassTotals {
+        std::string name;
+        uint64_t frameCount = 0;
+        frame_stats::PassStatistics total;
+        frame_stats::PassStatistics last;
+    };
+    // a handful of passes; looked up by name
+    std::vector<PassTotals> _passes;
+    uint64_t _occlusionTested = 0;
+    uint64_t _occlusionOccluded = 0;
+
+    double millisecondsBetween(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+}
+
+namespace frame_stats {
+    void markProcessStart() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _processStart = Clock::now();
+        _presentedAny = false;
+        _startupMs = 0.0;
+        _frameCount = 0;
+        _totalMs = 0.0;
+        _passes.clear();
+        _occlusionTested = 0;
+        _occlusionOccluded = 0;
+    }
+
+    void markFramePresented() {
+        Clock::time_point now = Clock::now();
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_presentedAny) {
+            _startupMs = millisecondsBetween(_processStart, now);
+            _presentedAny = true;
+        } else {
+            double frameMs = millisecondsBetween(_lastPresent, now);
+            _frameTimesMs[_frameCount % kFrameWindow] = frameMs;
+            _totalMs += frameMs;
+            ++_frameCount;
+        }
+        _lastPresent = now;
+    }
+
+    void recordPass(const char *name, const PassStatistics &statistics) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto pass = std::find_if(_passes.begin(), _passes.end(), [name](const PassTotals &totals) {
+            return totals.name == name;
+        });
+        if (pass == _passes.end()) {
+            _passes.emplace_back();
+            pass = _passes.end() - 1;
+            pass->name = name;
+        }
+        pass->frameCount++;
+        pass->total.vertexInvocations += statistics.vertexInvocations;
+        pass->total.clippingInvocations += statistics.clippingInvocations;
+        pass->total.fragmentInvocations += statistics.fragmentInvocations;
+        pass->last = statistics;
+    }
+
+    void recordOcclusion(uint64_t tested, uint64_t occluded) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _occlusionTested += tested;
+        _occlusionOccluded += occluded;
+    }
+
+    Summary summary() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Summary summary;
+        summary.startupMs = _startupMs;
+        summary.frameCount = _frameCount;
+        summary.occlusionTested = _occlusionTested;
+        summary.occlusionOccluded = _occlusionOccluded;
+        for (const PassTotals &totals : _passes) {
+            PassSummary pass;
+            pass.name = totals.name;
+            pass.frameCount = totals.frameCount;
+            pass.average.vertexInvocations = totals.total.vertexInvocations / totals.frameCount;
+            pass.average.clippingInvocations = totals.total.clippingInvocations / totals.frameCount;
+            pass.average.fragmentInvocations = totals.total.fragmentInvocations / totals.frameCount;
+            pass.last = totals.last;
+            summary.passes.push_back(pass);
+        }
+        if (_frameCount == 0) {
+            return summary;
+        }
+        summary.averageMs = _totalMs / _frameCount;
+
+        std::vector<double> window(_frameTimesMs, _frameTimesMs + std::min<uint64_t>(_frameCount, kFrameWindow));
+        std::sort(window.begin(), window.end());
+        auto percentile = [&window](double p) {
+            return window[std::min(window.size() - 1, (size_t)(p * window.size()))];
+        };
+        summary.p50Ms = percentile(0.50);
+        summary.p95Ms = percentile(0.95);
+        summary.p99Ms = percentile(0.99);
+        summary.maxMs = window.back();
+        return summary;
+    }
+
+    void logSummary() {
+        Summary s = summary();
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(2)
+             << "[stats] startup " << s.startupMs << " ms, " << s.frameCount << " frames"
+             << ", avg " << s.averageMs << " ms, p50 " << s.p50Ms << " ms, p95 " << s.p95Ms
+             << " ms, p99 " << s.p99Ms << " ms, max " << s.maxMs << " ms";
+        for (const PassSummary &pass : s.passes) {
+            line << "\n[stats] pass " << pass.name << " per frame: " << pass.average.vertexInvocations
+                 << " vertex, " << pass.average.clippingInvocations << " clipping, "
+                 << pass.average.fragmentInvocations << " fragment invocations";
+        }
+        if (s.occlusionTested > 0) {
+            line << "\n[stats] occlusion: " << s.occlusionOccluded << " of " << s.occlusionTested << " object tests occluded";
+        }
+        std::cout << line.str() << std::endl;
+    }
+
+    bool writeSummary(const std::string &path) {
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "[stats] can't open " << path << std::endl;
+            return false;
+        }
+        Summary s = summary();
+        file << std::fixed << std::setprecision(3)
+             << "startup_ms " << s.startupMs << "\n"
+             << "frames " << s.frameCount << "\n"
+             << "average_ms " << s.averageMs << "\n"
+             << "p50_ms " << s.p50Ms << "\n"
+             << "p95_ms " << s.p95Ms << "\n"
+             << "p99_ms " << s.p99Ms << "\n"
+             << "max_ms " << s.maxMs << "\n";
+        if (!file) {
+            std::cerr << "[stats] can't write " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Startup and frame timing plus per-pass GPU counters, recorded by the render
+// thread and summarized on demand.
+namespace frame_stats {
+    // counts for one pass of one frame, from pipeline statistics queries
+    struct PassStatistics {
+        uint64_t vertexInvocations = 0;
+        uint64_t clippingInvocations = 0;
+        uint64_t fragmentInvocations = 0;
+    };
+
+    struct PassSummary {
+        std::string name;
+        uint64_t frameCount = 0;
+        // per-frame averages over the whole run, and the last frame's counts
+        PassStatistics average;
+        PassStatistics last;
+    };
+
+    struct Summary {
+        double startupMs = 0.0;   // process start until the first present
+        uint64_t frameCount = 0;
+        double averageMs = 0.0;
+        // percentiles and max cover the most recent frames only
+        double p50Ms = 0.0;
+        double p95Ms = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+
+        std::vector<PassSummary> passes;
+        // objects tested with occlusion queries, and how many of those had no samples pass
+        uint64_t occlusionTested = 0;
+        uint64_t occlusionOccluded = 0;
+    };
+
+    // call as early as possible in main()
+    void markProcessStart();
+    // call once per presented frame
+    void markFramePresented();
+    // call once per retired frame and pass, with the pass's query results
+    void recordPass(const char *name, const PassStatistics &statistics);
+    // call once per retired frame with its occlusion query results
+    void recordOcclusion(uint64_t tested, uint64_t occluded);
+
+    Summary summary();
+    void logSummary();
+    // one "name value" line per timing, for the regression tests to compare against a baseline
+    bool writeSummary(const std::string &path);
+}
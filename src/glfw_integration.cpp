@@ -1,7 +1,13 @@
 #include "glfw_integration.hpp"
 
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
 
+#include "host_allocator.hpp"
 #include "include_vulkan.hpp"
 #include <GLFW/glfw3.h>
 
@@ -9,27 +15,86 @@ const uint32_t kWindowWidth = 800;
 const uint32_t kWindowHeight = 600;
 
 namespace {
-    GLFWwindow *_window;
+    // offset of each window from its monitor's origin, or from the previous window
+    const int kWindowMargin = 32;
+
+    // the first window is the primary one: cursor input is read from it
+    std::vector<GLFWwindow *> _windows;
+
+    // without windows there is no event queue, so waits and wake-ups go through these
+    bool _headless = false;
+    uint32_t _headlessWindowCount = 0;
+    std::chrono::steady_clock::time_point _headlessStart;
+    std::mutex _wakeMutex;
+    std::condition_variable _wakeCondition;
+    bool _wakeRequested = false;
 }
 
 namespace glfw {
-    void initialize() {
+    void initialize(uint32_t windowCount, bool headless) {
+        assert(windowCount > 0);
+        _headless = headless;
+        if (_headless) {
+            _headlessWindowCount = windowCount;
+            _headlessStart = std::chrono::steady_clock::now();
+            return;
+        }
+
         glfwInit();
         assert(glfwVulkanSupported() == GLFW_TRUE);
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-        _window = glfwCreateWindow(kWindowWidth, kWindowHeight, "Vulkan window", nullptr, nullptr);
+
+        int monitorCount = 0;
+        GLFWmonitor **monitors = glfwGetMonitors(&monitorCount);
+        for (uint32_t i = 0; i < windowCount; ++i) {
+            std::string title = "Vulkan window";
+            if (windowCount > 1) {
+                title += " " + std::to_string(i + 1);
+            }
+            GLFWwindow *window = glfwCreateWindow(kWindowWidth, kWindowHeight, title.c_str(), nullptr, nullptr);
+            assert(window != nullptr);
+
+            // one window per monitor while there are monitors left, then side by side
+            if (windowCount > 1) {
+                int x = 0, y = 0;
+                if (i < (uint32_t)monitorCount) {
+                    glfwGetMonitorPos(monitors[i], &x, &y);
+                } else {
+                    glfwGetWindowPos(_windows.back(), &x, &y);
+                    x += kWindowWidth;
+                }
+                glfwSetWindowPos(window, x + kWindowMargin, y + kWindowMargin);
+            }
+            _windows.push_back(window);
+        }
     }
 
     void shutdown() {
-        glfwDestroyWindow(_window);
+        if (_headless) {
+            _headlessWindowCount = 0;
+            return;
+        }
+        for (GLFWwindow *window : _windows) {
+            glfwDestroyWindow(window);
+        }
+        _windows.clear();
         glfwTerminate();
     }
 
-    void* createSurface(void *vulkanInstance) {
+    uint32_t windowCount() {
+        return _headless ? _headlessWindowCount : (uint32_t)_windows.size();
+    }
+
+    bool headless() {
+        return _headless;
+    }
+
+    void* createSurface(void *vulkanInstance, uint32_t window) {
+        assert(window < _windows.size());
         VkInstance instance = (VkInstance)vulkanInstance;
         VkSurfaceKHR surface;
-        VkResult result = glfwCreateWindowSurface(instance, _window, nullptr, &surface);
+        VkResult result = glfwCreateWindowSurface(instance, _windows[window], host_allocator::callbacks(), &surface);
         assert(result == VK_SUCCESS);
         return surface;
     }
@@ -39,6 +104,9 @@ namespace glfw {
     }
 
     std::vector<const char *> requiredVulkanExtensions() {
+        if (_headless) {
+            return { VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME };
+        }
         uint32_t extensionCount = 0;
         const char **extensions = glfwGetRequiredInstanceExtensions(&extensionCount);
         // glfw internal pointers are guaranteed to be valid until the library is terminated
@@ -50,10 +118,70 @@ namespace glfw {
     }
 
     bool shouldCloseWindow() {
-        return glfwWindowShouldClose(_window);
+        // the windows are views of one scene; closing any of them ends the run
+        for (GLFWwindow *window : _windows) {
+            if (glfwWindowShouldClose(window)) {
+                return true;
+            }
+        }
+        return false;
     }
 
     void pollEvents() {
-        glfwPollEvents();
+        if (!_headless) {
+            glfwPollEvents();
+        }
+    }
+
+    void waitEvents(double timeoutSeconds) {
+        if (_headless) {
+            std::unique_lock<std::mutex> lock(_wakeMutex);
+            _wakeCondition.wait_for(lock, std::chrono::duration<double>(timeoutSeconds), [] { return _wakeRequested; });
+            _wakeRequested = false;
+            return;
+        }
+        glfwWaitEventsTimeout(timeoutSeconds);
+    }
+
+    double time() {
+        if (_headless) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - _headlessStart).count();
+        }
+        return glfwGetTime();
+    }
+
+    std::pair<double, double> cursorPosition() {
+        if (_headless) {
+            return std::make_pair(kWindowWidth / 2.0, kWindowHeight / 2.0);
+        }
+        double x = 0.0, y = 0.0;
+        glfwGetCursorPos(_windows.front(), &x, &y);
+        return std::make_pair(x, y);
+    }
+
+    std::pair<double, double> pixelScale() {
+        if (_headless) {
+            return std::make_pair(1.0, 1.0);
+        }
+        int windowWidth = 0, windowHeight = 0;
+        int framebufferWidth = 0, framebufferHeight = 0;
+        glfwGetWindowSize(_windows.front(), &windowWidth, &windowHeight);
+        glfwGetFramebufferSize(_windows.front(), &framebufferWidth, &framebufferHeight);
+        if (windowWidth == 0 || windowHeight == 0) { // minimized
+            return std::make_pair(1.0, 1.0);
+        }
+        return std::make_pair((double)framebufferWidth / windowWidth, (double)framebufferHeight / windowHeight);
+    }
+
+    void wakeUp() {
+        if (_headless) {
+            {
+                std::lock_guard<std::mutex> lock(_wakeMutex);
+                _wakeRequested = true;
+            }
+            _wakeCondition.notify_one();
+            return;
+        }
+        glfwPostEmptyEvent();
     }
 }
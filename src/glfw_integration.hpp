@@ -1,19 +1,36 @@
 
 #pragma once
 
+#include <cstdint>
 #include <utility>
 #include <vector>
 
 namespace glfw {
-    void initialize();
+    // windows all have the same size; with several, they are spread across monitors.
+    // headless opens no windows and needs no display: the outputs are
+    // VK_EXT_headless_surface surfaces, the cursor rests at the window center and
+    // nothing asks to close, so runs end through --frames
+    void initialize(uint32_t windowCount = 1, bool headless = false);
     void shutdown();
+    uint32_t windowCount();
+    bool headless();
 
-    // vulkan integration
-    void* createSurface(void *vulkanInstance);
+    // vulkan integration; createSurface() is for windows only
+    void* createSurface(void *vulkanInstance, uint32_t window);
     std::pair<uint32_t, uint32_t> windowSize();
     std::vector<const char *> requiredVulkanExtensions();
 
     // internal functionality
+    // true once any of the windows was asked to close
     bool shouldCloseWindow();
     void pollEvents();
+    void waitEvents(double timeoutSeconds);
+    double time();
+    // relative to the first window, in window coordinates
+    std::pair<double, double> cursorPosition();
+    // framebuffer pixels per window coordinate of the first window; 2 on Retina displays
+    std::pair<double, double> pixelScale();
+
+    // thread-safe; unblocks a pending waitEvents() on the main thread
+    void wakeUp();
 }
@@ -0,0 +1,408 @@
+#include "gpu_queries.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <vector>
+
+#include "device_memory.hpp"
+#include "frame_stats.hpp"
+#include "host_allocator.hpp"
+#include "profiler.hpp"
+#include "vulkan_dispatch.hpp"
+#include "vulkan_handles.hpp"
+
+namespace {
+    using gpu_queries::Pass;
+
+    // objects with larger ids are never tested, and always drawn
+    const uint32_t kMaxOcclusionQueries = 4096;
+
+    // results come back in bit order: vertex, clipping, fragment
+    const VkQueryPipelineStatisticFlags kStatistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+                                                      VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+                                                      VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    const uint32_t kStatisticCount = 3;
+
+    // a begin and an end timestamp per pass
+    const uint32_t kTimestampCount = 2 * (uint32_t)Pass::Count;
+
+    struct Slot {
+        handles::QueryPool statisticsPool;
+        handles::QueryPool occlusionPool;
+        handles::QueryPool timestampPool;
+        bool recorded = false;
+        // profiler time when recording finished, shortly before submission
+        int64_t recordedAt = 0;
+        bool passRecorded[(size_t)Pass::Count] = {};
+        // object ids tested in the frame, sorted; only these queries are reset
+        std::vector<uint32_t> tested;
+        size_t queriesIssued = 0;
+    };
+
+    gpu_queries::Settings _settings;
+    VkDevice _device = VK_NULL_HANDLE;
+    gpu_queries::Features _features;
+    std::vector<Slot> _slots;
+    Slot *_current = nullptr;
+    bool _conditionalActive = false;
+
+    // one 32-bit predicate per object id, written on the GPU by query result copies
+    handles::Buffer _predicateBuffer;
+    handles::DeviceMemory _predicateMemory;
+
+    // the same predicates on the CPU, from the last results read back
+    std::vector<uint8_t> _visible;
+    std::vector<uint64_t> _results;
+
+    // GPU timestamps plus this land on the profiler clock. Without calibrated
+    // timestamps it is only pushed forward, just far enough that no frame's GPU
+    // work appears to start before the frame was recorded
+    int64_t _gpuClockOffset = 0;
+    bool _gpuClockAligned = false;
+
+    handles::QueryPool createPool(VkQueryType type, uint32_t count, VkQueryPipelineStatisticFlags statistics) {
+        VkQueryPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = type;
+        poolInfo.queryCount = count;
+        poolInfo.pipelineStatistics = statistics;
+
+        VkQueryPool pool;
+        VkResult result = dispatch::device.vkCreateQueryPool(_device, &poolInfo, host_allocator::callbacks(), &pool);
+        assert(result == VK_SUCCESS);
+        return handles::QueryPool(_device, pool);
+    }
+
+    void createPredicateBuffer() {
+        const VkDeviceSize size = sizeof(uint32_t) * kMaxOcclusionQueries;
+        {
+            VkBufferCreateInfo bufferInfo = {};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = size;
+            bufferInfo.usage = VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            VkBuffer handle;
+            VkResult result = dispatch::device.vkCreateBuffer(_device, &bufferInfo, host_allocator::callbacks(), &handle);
+            assert(result == VK_SUCCESS);
+            _predicateBuffer = handles::Buffer(_device, handle);
+        }
+
+        VkMemoryRequirements requirements;
+        dispatch::device.vkGetBufferMemoryRequirements(_device, _predicateBuffer.get(), &requirements);
+
+        // host visible only so it can start out as "everything visible"
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = requirements.size;
+        allocInfo.memoryTypeIndex = device_memory::findMemoryType(requirements.memoryTypeBits,
+                                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        assert(allocInfo.memoryTypeIndex != std::numeric_limits<uint32_t>::max());
+
+        VkDeviceMemory handle;
+        VkResult result = device_memory::allocate(_device, allocInfo, device_memory::Category::Buffers, &handle);
+        assert(result == VK_SUCCESS);
+        _predicateMemory = handles::DeviceMemory(_device, handle);
+
+        result = dispatch::device.vkBindBufferMemory(_device, _predicateBuffer.get(), _predicateMemory.get(), 0);
+        assert(result == VK_SUCCESS);
+
+        void *mapped = nullptr;
+        result = dispatch::device.vkMapMemory(_device, _predicateMemory.get(), 0, VK_WHOLE_SIZE, 0, &mapped);
+        assert(result == VK_SUCCESS);
+        std::fill((uint32_t *)mapped, (uint32_t *)mapped + kMaxOcclusionQueries, 1u);
+        dispatch::device.vkUnmapMemory(_device, _predicateMemory.get());
+    }
+
+    // calls `f(first, count)` for each run of consecutive ids in a sorted list
+    template <typename F>
+    void forEachRun(const std::vector<uint32_t> &ids, F f) {
+        size_t begin = 0;
+        while (begin < ids.size()) {
+            size_t end = begin + 1;
+            while (end < ids.size() && ids[end] == ids[end - 1] + 1) {
+                ++end;
+            }
+            f(ids[begin], (uint32_t)(end - begin));
+            begin = end;
+        }
+    }
+}
+
+namespace timestamps {
+    void collect(const Slot &frame) {
+        if (!profiler::enabled()) {
+            return;
+        }
+        const uint64_t mask = _features.timestampValidBits >= 64 ? ~0ull : (1ull << _features.timestampValidBits) - 1;
+        const double period = _features.timestampPeriod;
+        int64_t begins[(size_t)Pass::Count] = {};
+        int64_t ends[(size_t)Pass::Count] = {};
+        bool valid[(size_t)Pass::Count] = {};
+        bool any = false;
+        uint64_t origin = 0;
+        for (size_t pass = 0; pass < (size_t)Pass::Count; ++pass) {
+            uint64_t ticks[2] = {};
+            if (!frame.passRecorded[pass] ||
+                dispatch::device.vkGetQueryPoolResults(_device, frame.timestampPool.get(), 2 * (uint32_t)pass, 2, sizeof(ticks), ticks,
+                                                       sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+                continue;
+            }
+            ticks[0] &= mask;
+            ticks[1] &= mask;
+            if (!any) {
+                origin = ticks[0];
+                any = true;
+            }
+            // relative to the frame's first timestamp, so the counter wrapping doesn't matter
+            begins[pass] = (int64_t)(((ticks[0] - origin) & mask) * period);
+            ends[pass] = (int64_t)(((ticks[1] - origin) & mask) * period);
+            valid[pass] = true;
+        }
+        if (!any) {
+            return;
+        }
+
+        const int64_t originNs = (int64_t)(origin * period);
+        if (!_gpuClockAligned || originNs + _gpuClockOffset < frame.recordedAt) {
+            _gpuClockOffset = frame.recordedAt - originNs;
+            _gpuClockAligned = true;
+        }
+        const int64_t base = originNs + _gpuClockOffset;
+        for (size_t pass = 0; pass < (size_t)Pass::Count; ++pass) {
+            if (valid[pass]) {
+                profiler::gpuEvent(gpu_queries::passName((Pass)pass), base + begins[pass], base + ends[pass]);
+            }
+        }
+    }
+}
+
+namespace gpu_queries {
+    const char *passName(Pass pass) {
+        switch (pass) {
+            case Pass::OcclusionProxies: return "occlusion proxies";
+            case Pass::Scene: return "scene";
+            case Pass::Sprites: return "sprites";
+            default: return "unknown";
+        }
+    }
+
+    void configure(const Settings &settings) {
+        _settings = settings;
+    }
+
+    bool occlusionCulling() {
+        return _settings.occlusionCulling;
+    }
+
+    void initialize(VkDevice device, const Features &features, uint32_t framesInFlight) {
+        _device = device;
+        _features = features;
+        _features.conditionalRendering = _features.conditionalRendering && _settings.occlusionCulling;
+
+        if (_features.conditionalRendering) {
+            _features.conditionalRendering = dispatch::device.vkCmdBeginConditionalRenderingEXT != nullptr
+                && dispatch::device.vkCmdEndConditionalRenderingEXT != nullptr;
+        }
+        if (_features.conditionalRendering) {
+            createPredicateBuffer();
+        }
+
+        _slots.resize(framesInFlight);
+        for (Slot &slot : _slots) {
+            if (_features.pipelineStatistics) {
+                slot.statisticsPool = createPool(VK_QUERY_TYPE_PIPELINE_STATISTICS, (uint32_t)Pass::Count, kStatistics);
+            }
+            if (_settings.occlusionCulling) {
+                slot.occlusionPool = createPool(VK_QUERY_TYPE_OCCLUSION, kMaxOcclusionQueries, 0);
+            }
+            if (_features.timestampPeriod > 0.0f) {
+                slot.timestampPool = createPool(VK_QUERY_TYPE_TIMESTAMP, kTimestampCount, 0);
+            }
+            slot.tested.reserve(256);
+        }
+        _visible.assign(kMaxOcclusionQueries, 1);
+    }
+
+    void shutdown() {
+        _slots.clear();
+        _current = nullptr;
+        _predicateBuffer.reset();
+        _predicateMemory.reset();
+        _visible.clear();
+        _results.clear();
+        _gpuClockAligned = false;
+        _features = Features();
+        _device = VK_NULL_HANDLE;
+    }
+
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t slot, const std::vector<uint32_t> &occlusionIds) {
+        _current = &_slots[slot];
+        _current->recorded = true;
+        std::fill(std::begin(_current->passRecorded), std::end(_current->passRecorded), false);
+
+        std::vector<uint32_t> &tested = _current->tested;
+        tested.clear();
+        _current->queriesIssued = 0;
+        if (_settings.occlusionCulling) {
+            for (uint32_t id : occlusionIds) {
+                if (id < kMaxOcclusionQueries) {
+                    tested.push_back(id);
+                }
+            }
+            std::sort(tested.begin(), tested.end());
+        }
+
+        if (_features.pipelineStatistics) {
+            dispatch::device.vkCmdResetQueryPool(commandBuffer, _current->statisticsPool.get(), 0, (uint32_t)Pass::Count);
+        }
+        // a reset of all 4096 costs the GPU even when only a handful are used
+        forEachRun(tested, [commandBuffer](uint32_t first, uint32_t count) {
+            dispatch::device.vkCmdResetQueryPool(commandBuffer, _current->occlusionPool.get(), first, count);
+        });
+        if (_features.timestampPeriod > 0.0f) {
+            dispatch::device.vkCmdResetQueryPool(commandBuffer, _current->timestampPool.get(), 0, kTimestampCount);
+        }
+    }
+
+    void endFrame(VkCommandBuffer commandBuffer) {
+        assert(_current != nullptr && !_conditionalActive);
+        const std::vector<uint32_t> &tested = _current->tested;
+        // a reset query that never ran would stall the copy below and the readback
+        assert(_current->queriesIssued == tested.size());
+
+        if (_features.conditionalRendering && !tested.empty()) {
+            // this frame's conditional draws have read their predicates before they are overwritten...
+            dispatch::device.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                                  0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+            forEachRun(tested, [commandBuffer](uint32_t first, uint32_t count) {
+                dispatch::device.vkCmdCopyQueryPoolResults(commandBuffer, _current->occlusionPool.get(), first, count, _predicateBuffer.get(),
+                                                           sizeof(uint32_t) * first, sizeof(uint32_t), VK_QUERY_RESULT_WAIT_BIT);
+            });
+
+            // ...and the next frame's wait for the new ones
+            VkBufferMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = _predicateBuffer.get();
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+            dispatch::device.vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT,
+                                                  0, 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+        _current->recordedAt = profiler::now();
+        _current = nullptr;
+    }
+
+    void beginPass(VkCommandBuffer commandBuffer, Pass pass) {
+        _current->passRecorded[(size_t)pass] = true;
+        if (_features.timestampPeriod > 0.0f) {
+            dispatch::device.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _current->timestampPool.get(), 2 * (uint32_t)pass);
+        }
+        if (_features.pipelineStatistics) {
+            dispatch::device.vkCmdBeginQuery(commandBuffer, _current->statisticsPool.get(), (uint32_t)pass, 0);
+        }
+    }
+
+    void endPass(VkCommandBuffer commandBuffer, Pass pass) {
+        if (_features.pipelineStatistics) {
+            dispatch::device.vkCmdEndQuery(commandBuffer, _current->statisticsPool.get(), (uint32_t)pass);
+        }
+        if (_features.timestampPeriod > 0.0f) {
+            dispatch::device.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _current->timestampPool.get(), 2 * (uint32_t)pass + 1);
+        }
+    }
+
+    bool beginOcclusionQuery(VkCommandBuffer commandBuffer, uint32_t objectId) {
+        if (!_settings.occlusionCulling || objectId >= kMaxOcclusionQueries) {
+            return false;
+        }
+        assert(std::binary_search(_current->tested.begin(), _current->tested.end(), objectId));
+        ++_current->queriesIssued;
+        // not precise: any sample passing is all the predicate needs
+        dispatch::device.vkCmdBeginQuery(commandBuffer, _current->occlusionPool.get(), objectId, 0);
+        return true;
+    }
+
+    void endOcclusionQuery(VkCommandBuffer commandBuffer, uint32_t objectId) {
+        dispatch::device.vkCmdEndQuery(commandBuffer, _current->occlusionPool.get(), objectId);
+    }
+
+    bool beginConditionalDraw(VkCommandBuffer commandBuffer, uint32_t objectId) {
+        assert(!_conditionalActive);
+        if (!_settings.occlusionCulling || objectId >= kMaxOcclusionQueries) {
+            return true;
+        }
+        if (!_features.conditionalRendering) {
+            return _visible[objectId] != 0;
+        }
+
+        VkConditionalRenderingBeginInfoEXT beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT;
+        beginInfo.buffer = _predicateBuffer.get();
+        beginInfo.offset = sizeof(uint32_t) * objectId;
+        dispatch::device.vkCmdBeginConditionalRenderingEXT(commandBuffer, &beginInfo);
+        _conditionalActive = true;
+        return true;
+    }
+
+    void endConditionalDraw(VkCommandBuffer commandBuffer) {
+        if (_conditionalActive) {
+            dispatch::device.vkCmdEndConditionalRenderingEXT(commandBuffer);
+            _conditionalActive = false;
+        }
+    }
+
+    void collect(uint32_t slot) {
+        Slot &frame = _slots[slot];
+        if (!frame.recorded) {
+            return;
+        }
+        frame.recorded = false;
+
+        if (_features.timestampPeriod > 0.0f) {
+            timestamps::collect(frame);
+        }
+
+        for (size_t pass = 0; pass < (size_t)Pass::Count && _features.pipelineStatistics; ++pass) {
+            if (!frame.passRecorded[pass]) {
+                continue;
+            }
+            uint64_t values[kStatisticCount] = {};
+            VkResult result = dispatch::device.vkGetQueryPoolResults(_device, frame.statisticsPool.get(), (uint32_t)pass, 1, sizeof(values), values,
+                                                                     sizeof(values), VK_QUERY_RESULT_64_BIT);
+            if (result != VK_SUCCESS) {
+                continue;
+            }
+            frame_stats::PassStatistics statistics;
+            statistics.vertexInvocations = values[0];
+            statistics.clippingInvocations = values[1];
+            statistics.fragmentInvocations = values[2];
+            frame_stats::recordPass(passName((Pass)pass), statistics);
+        }
+
+        if (frame.tested.empty()) {
+            return;
+        }
+        uint64_t occluded = 0;
+        forEachRun(frame.tested, [&frame, &occluded](uint32_t first, uint32_t count) {
+            _results.resize(count);
+            VkResult result = dispatch::device.vkGetQueryPoolResults(_device, frame.occlusionPool.get(), first, count, sizeof(uint64_t) * count,
+                                                                     _results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+            if (result != VK_SUCCESS) {
+                return;
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                _visible[first + i] = _results[i] != 0 ? 1 : 0;
+                occluded += _results[i] == 0 ? 1 : 0;
+            }
+        });
+        frame_stats::recordOcclusion(frame.tested.size(), occluded);
+    }
+}
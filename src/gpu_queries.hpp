@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "include_vulkan.hpp"
+
+// GPU-side instrumentation of the frame: pipeline statistics and timestamps
+// per pass, and occlusion queries that decide whether objects are drawn.
+// Queries live in pools per frame slot and are read back once the slot's fence
+// has been waited on; counters end up in frame_stats, timestamps on the
+// profiler's GPU track.
+//
+// Occlusion works a frame behind: each object is drawn as a proxy inside an
+// occlusion query, and the result gates the object's real draw in the next
+// frame recorded. With VK_EXT_conditional_rendering the GPU skips the draw
+// itself; without it, the CPU skips recording it once the result is read back.
+// It is off by default and culls nothing yet: the render pass has no depth
+// attachment, so every proxy on screen passes and only the pipeline statistics
+// and timestamps have an effect. Turning it on just adds the proxy draws.
+namespace gpu_queries {
+    enum class Pass : uint32_t {
+        OcclusionProxies,
+        Scene,
+        Sprites,
+        Count
+    };
+
+    const char *passName(Pass pass);
+
+    struct Settings {
+        // draw occlusion proxies and gate the real draws on their results
+        bool occlusionCulling = false;
+    };
+
+    // must be called before initialize()
+    void configure(const Settings &settings);
+    bool occlusionCulling();
+
+    struct Features {
+        // VkPhysicalDeviceFeatures::pipelineStatisticsQuery was enabled
+        bool pipelineStatistics = false;
+        // VK_EXT_conditional_rendering was enabled
+        bool conditionalRendering = false;
+        // nanoseconds per timestamp tick, 0 to record no timestamps
+        float timestampPeriod = 0.0f;
+        // VkQueueFamilyProperties::timestampValidBits of the graphics queue
+        uint32_t timestampValidBits = 0;
+    };
+
+    void initialize(VkDevice device, const Features &features, uint32_t framesInFlight);
+    void shutdown();
+
+    // outside the render pass, before any other query command of the frame;
+    // `occlusionIds` are exactly the objects whose proxies the frame will test
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t slot, const std::vector<uint32_t> &occlusionIds);
+    // outside the render pass, after every query of the frame has ended
+    void endFrame(VkCommandBuffer commandBuffer);
+
+    void beginPass(VkCommandBuffer commandBuffer, Pass pass);
+    void endPass(VkCommandBuffer commandBuffer, Pass pass);
+
+    // wraps the object's proxy draw; false when the object can't be tested, in
+    // which case the proxy need not be drawn and endOcclusionQuery() not called
+    bool beginOcclusionQuery(VkCommandBuffer commandBuffer, uint32_t objectId);
+    void endOcclusionQuery(VkCommandBuffer commandBuffer, uint32_t objectId);
+
+    // wraps the object's real draw; false when the draw should be left out
+    // altogether, in which case endConditionalDraw() must not be called
+    bool beginConditionalDraw(VkCommandBuffer commandBuffer, uint32_t objectId);
+    void endConditionalDraw(VkCommandBuffer commandBuffer);
+
+    // call once the slot's fence has signaled
+    void collect(uint32_t slot);
+}
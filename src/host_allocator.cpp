@@ -0,0 +1,350 @@
+#include "host_allocator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+
+namespace {
+    const size_t kScopeCount = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+    const char *kScopeNames[kScopeCount] = { "command", "object", "cache", "device", "instance" };
+
+    // every allocation is preceded by a header; 32 bytes keep what follows 16-byte aligned
+    const size_t kHeaderSize = 32;
+    const size_t kMinAlignment = 16;
+
+    // per-thread arenas bump through chunks of this size
+    const size_t kChunkSize = 64 * 1024;
+    const size_t kMaxArenaAllocation = kChunkSize / 8;
+
+    // size classes of 32 bytes to 4 KiB, carved out of slabs
+    const size_t kMinClassShift = 5;
+    const size_t kClassCount = 8;
+    const size_t kMaxClassSize = (size_t)1 << (kMinClassShift + kClassCount - 1);
+    const size_t kSlabSize = 64 * 1024;
+
+    enum class Source : uint16_t {
+        Arena,
+        Pool,
+        Heap
+    };
+
+    struct Header {
+        void *block;   // what the source handed out
+        void *chunk;   // arena allocations only
+        uint64_t size;
+        uint32_t scope;
+        Source source;
+        uint16_t sizeClass;
+    };
+    static_assert(sizeof(Header) <= kHeaderSize, "header must fit in front of the allocation");
+
+    struct ScopeCounters {
+        std::atomic<uint64_t> bytes { 0 };
+        std::atomic<uint64_t> peakBytes { 0 };
+        std::atomic<uint64_t> allocations { 0 };
+        std::atomic<uint64_t> internalBytes { 0 };
+    };
+
+    ScopeCounters _scopes[kScopeCount];
+    std::atomic<uint64_t> _bytes { 0 };
+    std::atomic<uint64_t> _peakBytes { 0 };
+    std::atomic<uint64_t> _reservedBytes { 0 };
+    std::atomic<uint64_t> _failedAllocations { 0 };
+    std::atomic<uint64_t> _limit { 0 };
+
+    size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    void raise(std::atomic<uint64_t> &peak, uint64_t value) {
+        uint64_t current = peak.load(std::memory_order_relaxed);
+        while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    std::string formatBytes(uint64_t bytes) {
+        const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+        double value = (double)bytes;
+        int unit = 0;
+        while (value >= 1024.0 && unit < 4) {
+            value /= 1024.0;
+            ++unit;
+        }
+        std::ostringstream stream;
+        stream << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << value << " " << units[unit];
+        return stream.str();
+    }
+}
+
+namespace arena {
+    // `live` counts allocations, plus one while the chunk is some thread's current
+    // chunk; the last one out frees it, on whichever thread that happens
+    struct Chunk {
+        std::atomic<size_t> live;
+        size_t used;
+    };
+    const size_t kDataOffset = alignUp(sizeof(Chunk), kMinAlignment);
+
+    void release(Chunk *chunk) {
+        if (chunk->live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            chunk->~Chunk();
+            std::free(chunk);
+            _reservedBytes.fetch_sub(kChunkSize, std::memory_order_relaxed);
+        }
+    }
+
+    struct ThreadArena {
+        Chunk *current = nullptr;
+
+        ~ThreadArena() {
+            if (current != nullptr) {
+                release(current);
+            }
+        }
+    };
+
+    thread_local ThreadArena _threadArena;
+
+    void *allocate(size_t size, Chunk **owner) {
+        ThreadArena &arena = _threadArena;
+        if (arena.current == nullptr || arena.current->used + size > kChunkSize) {
+            if (arena.current != nullptr) {
+                release(arena.current);
+                arena.current = nullptr;
+            }
+            void *memory = std::malloc(kChunkSize);
+            if (memory == nullptr) {
+                return nullptr;
+            }
+            Chunk *chunk = new (memory) Chunk();
+            chunk->live.store(1, std::memory_order_relaxed);
+            chunk->used = kDataOffset;
+            arena.current = chunk;
+            _reservedBytes.fetch_add(kChunkSize, std::memory_order_relaxed);
+        }
+        Chunk *chunk = arena.current;
+        void *block = (char *)chunk + chunk->used;
+        chunk->used += alignUp(size, kMinAlignment);
+        chunk->live.fetch_add(1, std::memory_order_relaxed);
+        *owner = chunk;
+        return block;
+    }
+}
+
+namespace pool {
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    // slabs are kept for the rest of the run; freed blocks go back on the list
+    struct SizeClass {
+        std::mutex mutex;
+        FreeBlock *free = nullptr;
+    };
+
+    SizeClass _classes[kClassCount];
+
+    // smallest class that fits, or kClassCount if none does
+    size_t classFor(size_t size) {
+        size_t sizeClass = 0;
+        while (sizeClass < kClassCount && ((size_t)1 << (kMinClassShift + sizeClass)) < size) {
+            ++sizeClass;
+        }
+        return sizeClass;
+    }
+
+    void *allocate(size_t sizeClass) {
+        SizeClass &pool = _classes[sizeClass];
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (pool.free == nullptr) {
+            char *slab = (char *)std::malloc(kSlabSize);
+            if (slab == nullptr) {
+                return nullptr;
+            }
+            _reservedBytes.fetch_add(kSlabSize, std::memory_order_relaxed);
+            const size_t blockSize = (size_t)1 << (kMinClassShift + sizeClass);
+            for (size_t offset = kSlabSize; offset >= blockSize; offset -= blockSize) {
+                FreeBlock *block = (FreeBlock *)(slab + offset - blockSize);
+                block->next = pool.free;
+                pool.free = block;
+            }
+        }
+        FreeBlock *block = pool.free;
+        pool.free = block->next;
+        return block;
+    }
+
+    void free(void *memory, size_t sizeClass) {
+        SizeClass &pool = _classes[sizeClass];
+        FreeBlock *block = (FreeBlock *)memory;
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        block->next = pool.free;
+        pool.free = block;
+    }
+}
+
+namespace callbacks {
+    void VKAPI_PTR free(void *userData, void *memory);
+
+    void *VKAPI_PTR allocate(void *userData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+        if (size == 0) {
+            return nullptr;
+        }
+
+        const uint64_t total = _bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        const uint64_t limit = _limit.load(std::memory_order_relaxed);
+        if (limit != 0 && total > limit) {
+            _bytes.fetch_sub(size, std::memory_order_relaxed);
+            _failedAllocations.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        alignment = std::max(alignment, kMinAlignment);
+        const size_t blockSize = size + kHeaderSize + alignment - kMinAlignment;
+        Header header = {};
+        header.size = size;
+        header.scope = (uint32_t)scope;
+        if (scope == VK_SYSTEM_ALLOCATION_SCOPE_OBJECT && blockSize <= kMaxArenaAllocation) {
+            arena::Chunk *chunk = nullptr;
+            header.source = Source::Arena;
+            header.block = arena::allocate(blockSize, &chunk);
+            header.chunk = chunk;
+        } else if (blockSize <= kMaxClassSize) {
+            header.source = Source::Pool;
+            header.sizeClass = (uint16_t)pool::classFor(blockSize);
+            header.block = pool::allocate(header.sizeClass);
+        } else {
+            header.source = Source::Heap;
+            header.block = std::malloc(blockSize);
+        }
+        if (header.block == nullptr) {
+            _bytes.fetch_sub(size, std::memory_order_relaxed);
+            _failedAllocations.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        char *memory = (char *)alignUp((size_t)header.block + kHeaderSize, alignment);
+        memcpy(memory - kHeaderSize, &header, sizeof(header));
+
+        ScopeCounters &counters = _scopes[scope];
+        raise(counters.peakBytes, counters.bytes.fetch_add(size, std::memory_order_relaxed) + size);
+        counters.allocations.fetch_add(1, std::memory_order_relaxed);
+        raise(_peakBytes, total);
+        return memory;
+    }
+
+    void *VKAPI_PTR reallocate(void *userData, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+        if (original == nullptr) {
+            return allocate(userData, size, alignment, scope);
+        }
+        if (size == 0) {
+            free(userData, original);
+            return nullptr;
+        }
+        // the original must survive a failed reallocation
+        void *memory = allocate(userData, size, alignment, scope);
+        if (memory == nullptr) {
+            return nullptr;
+        }
+        const Header *header = (const Header *)((char *)original - kHeaderSize);
+        memcpy(memory, original, std::min<size_t>(size, header->size));
+        free(userData, original);
+        return memory;
+    }
+
+    void VKAPI_PTR free(void *userData, void *memory) {
+        if (memory == nullptr) {
+            return;
+        }
+        Header header;
+        memcpy(&header, (char *)memory - kHeaderSize, sizeof(header));
+
+        ScopeCounters &counters = _scopes[header.scope];
+        counters.bytes.fetch_sub(header.size, std::memory_order_relaxed);
+        counters.allocations.fetch_sub(1, std::memory_order_relaxed);
+        _bytes.fetch_sub(header.size, std::memory_order_relaxed);
+
+        switch (header.source) {
+            case Source::Arena:
+                arena::release((arena::Chunk *)header.chunk);
+                break;
+            case Source::Pool:
+                pool::free(header.block, header.sizeClass);
+                break;
+            case Source::Heap:
+                std::free(header.block);
+                break;
+        }
+    }
+
+    // allocations the driver makes itself, e.g. for executable memory
+    void VKAPI_PTR internalAllocation(void *userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+        _scopes[scope].internalBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void VKAPI_PTR internalFree(void *userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+        _scopes[scope].internalBytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    const VkAllocationCallbacks _callbacks = {
+        nullptr,
+        allocate,
+        reallocate,
+        free,
+        internalAllocation,
+        internalFree,
+    };
+}
+
+namespace host_allocator {
+    void setLimit(uint64_t bytes) {
+        _limit.store(bytes, std::memory_order_relaxed);
+    }
+
+    const VkAllocationCallbacks *callbacks() {
+        return &callbacks::_callbacks;
+    }
+
+    Usage usage() {
+        Usage usage;
+        for (size_t scope = 0; scope < kScopeCount; ++scope) {
+            usage.scopes[scope].bytes = _scopes[scope].bytes.load(std::memory_order_relaxed);
+            usage.scopes[scope].peakBytes = _scopes[scope].peakBytes.load(std::memory_order_relaxed);
+            usage.scopes[scope].allocations = _scopes[scope].allocations.load(std::memory_order_relaxed);
+            usage.scopes[scope].internalBytes = _scopes[scope].internalBytes.load(std::memory_order_relaxed);
+        }
+        usage.bytes = _bytes.load(std::memory_order_relaxed);
+        usage.peakBytes = _peakBytes.load(std::memory_order_relaxed);
+        usage.reservedBytes = _reservedBytes.load(std::memory_order_relaxed);
+        usage.failedAllocations = _failedAllocations.load(std::memory_order_relaxed);
+        return usage;
+    }
+
+    void logUsage() {
+        Usage current = usage();
+        std::ostringstream line;
+        line << "[host memory] " << formatBytes(current.bytes) << " in use, peak " << formatBytes(current.peakBytes)
+             << ", " << formatBytes(current.reservedBytes) << " reserved";
+        if (current.failedAllocations > 0) {
+            line << ", " << current.failedAllocations << " allocations refused";
+        }
+        line << " (";
+        for (size_t scope = 0; scope < kScopeCount; ++scope) {
+            const ScopeUsage &usage = current.scopes[scope];
+            line << (scope > 0 ? ", " : "") << kScopeNames[scope] << " " << formatBytes(usage.bytes)
+                 << " peak " << formatBytes(usage.peakBytes);
+            if (usage.internalBytes > 0) {
+                line << " + " << formatBytes(usage.internalBytes) << " internal";
+            }
+        }
+        line << ")";
+        std::cout << line.str() << std::endl;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "include_vulkan.hpp"
+
+// VkAllocationCallbacks for every Vulkan call that takes an allocator, so the
+// driver's host memory is counted and can be capped. Object-scope allocations
+// come from per-thread bump arenas; every other scope from size-class pools;
+// anything too large for either goes to malloc. Safe to use from any thread,
+// and memory may be freed on a different thread than it was allocated on.
+namespace host_allocator {
+    struct ScopeUsage {
+        uint64_t bytes = 0;       // currently allocated, as requested by the driver
+        uint64_t peakBytes = 0;
+        uint64_t allocations = 0; // currently live
+        uint64_t internalBytes = 0; // driver allocations it only reported to us
+    };
+
+    struct Usage {
+        // indexed by VkSystemAllocationScope
+        ScopeUsage scopes[VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1];
+        uint64_t bytes = 0;
+        uint64_t peakBytes = 0;
+        // arena chunks and pool slabs held, including unused space
+        uint64_t reservedBytes = 0;
+        uint64_t failedAllocations = 0;
+    };
+
+    // allocations that would take the total past `bytes` fail, which the
+    // driver reports as VK_ERROR_OUT_OF_HOST_MEMORY; 0 removes the cap
+    void setLimit(uint64_t bytes);
+
+    // pass wherever Vulkan takes a pAllocator; the same pointer for the whole run
+    const VkAllocationCallbacks *callbacks();
+
+    Usage usage();
+    void logUsage();
+}
@@ -1,26 +1,216 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
 
+#include "frame_capture.hpp"
+#include "frame_stats.hpp"
 #include "glfw_integration.hpp"
+#include "gpu_queries.hpp"
+#include "host_allocator.hpp"
+#include "mesh_loader.hpp"
+#include "profiler.hpp"
+#include "render_thread.hpp"
+#include "scene_objects.hpp"
+#include "thread_pool.hpp"
 #include "vulkan_integration.hpp"
 
 // https://vulkan-tutorial.com/
 
+namespace {
+    // upper bound on how long the main thread sleeps while the render thread is behind
+    const double kEventWaitTimeout = 0.005;
+
+    // --capture <directory> [--capture-format raw|ppm|png] | --capture-pipe "<command>"
+    frame_capture::Settings captureSettings(int argc, const char * argv[]) {
+        frame_capture::Settings settings;
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (strcmp(argv[i], "--capture") == 0) {
+                settings.enabled = true;
+                settings.directory = argv[++i];
+            } else if (strcmp(argv[i], "--capture-pipe") == 0) {
+                // raw frames; e.g. ffmpeg -f rawvideo -pix_fmt bgra -s 800x600 -i - out.mp4
+                settings.enabled = true;
+                settings.pipeCommand = argv[++i];
+            } else if (strcmp(argv[i], "--capture-format") == 0) {
+                const char *format = argv[++i];
+                if (strcmp(format, "raw") == 0) {
+                    settings.format = frame_capture::Format::Raw;
+                } else if (strcmp(format, "png") == 0) {
+                    settings.format = frame_capture::Format::Png;
+                } else if (strcmp(format, "ppm") == 0) {
+                    settings.format = frame_capture::Format::Ppm;
+                } else {
+                    std::cerr << "unknown capture format " << format << ", using ppm" << std::endl;
+                }
+            }
+        }
+        return settings;
+    }
+
+    // the value following `name`, or nullptr when the option isn't given
+    const char *optionValue(int argc, const char * argv[], const char *name) {
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (strcmp(argv[i], name) == 0) {
+                return argv[i + 1];
+            }
+        }
+        return nullptr;
+    }
+
+    // --mesh <file.obj|file.glb|file.meshcache> [--mesh-cache <file.meshcache>]
+    // imports a mesh and reports how long it took. With --mesh-cache the cache
+    // is mapped instead when it is valid, and rewritten from the import when not.
+    void importMesh(int argc, const char * argv[]) {
+        const char *path = optionValue(argc, argv, "--mesh");
+        if (path == nullptr) {
+            return;
+        }
+        const char *cachePath = optionValue(argc, argv, "--mesh-cache");
+        auto start = std::chrono::steady_clock::now();
+        auto elapsedMs = [&start] {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        auto isCache = [](const std::string &name) {
+            return name.size() > 10 && name.compare(name.size() - 10, 10, ".meshcache") == 0;
+        };
+        std::string name(path);
+        if (isCache(name) || cachePath != nullptr) {
+            std::string cacheName = isCache(name) ? name : std::string(cachePath);
+            mesh_loader::MeshView view;
+            if (mesh_loader::loadCache(cacheName, view)) {
+                std::cout << "[mesh] " << cacheName << ": " << view.vertexCount << " vertices, " << view.indexCount
+                          << " indices, " << view.submeshCount << " submeshes mapped in " << elapsedMs() << " ms" << std::endl;
+                return;
+            }
+            if (isCache(name)) { // no source to import again
+                return;
+            }
+            std::cout << "[mesh] importing " << name << " again" << std::endl;
+            start = std::chrono::steady_clock::now();
+        }
+
+        mesh_loader::Mesh mesh;
+        if (!mesh_loader::load(name, mesh)) {
+            return;
+        }
+        std::cout << "[mesh] " << name << ": " << mesh.vertices.size() << " vertices, " << mesh.indices.size()
+                  << " indices, " << mesh.submeshes.size() << " submeshes imported in " << elapsedMs()
+                  << " ms on " << thread_pool::concurrency() << " threads, "
+                  << mesh_loader::cacheMissRatio(mesh) << " vertices per triangle" << std::endl;
+        if (cachePath != nullptr && mesh_loader::writeCache(cachePath, mesh)) {
+            std::cout << "[mesh] wrote " << cachePath << std::endl;
+        }
+    }
+}
+
 int main(int argc, const char * argv[]) {
+    frame_stats::markProcessStart();
+    // --trace <file.json> records a CPU/GPU timeline for chrome://tracing or ui.perfetto.dev
+    const char *tracePath = optionValue(argc, argv, "--trace");
+    if (tracePath != nullptr) {
+        profiler::start();
+    }
+    profiler::setThreadName("main");
+    thread_pool::start();
+
+    // --cull-benchmark <objects> measures culling throughput and exits
+    if (const char *objects = optionValue(argc, argv, "--cull-benchmark")) {
+        scene_objects::benchmark(strtoull(objects, nullptr, 10));
+        thread_pool::stop();
+        return 0;
+    }
+
+    // --host-memory-limit <MiB> caps the driver's host allocations to exercise its out-of-memory paths
+    if (const char *limit = optionValue(argc, argv, "--host-memory-limit")) {
+        host_allocator::setLimit(strtoull(limit, nullptr, 10) * 1024 * 1024);
+    }
+
+    // --vsync off presents without waiting for the display
+    vulkan::Settings vulkanSettings;
+    if (const char *vsync = optionValue(argc, argv, "--vsync")) {
+        vulkanSettings.vsync = strcmp(vsync, "off") != 0;
+    }
+    vulkan::configure(vulkanSettings);
     vulkan::prepareEnvironment();
+    frame_capture::configure(captureSettings(argc, argv));
+
+    // --occlusion-culling on draws occlusion proxies; they find nothing hidden until the render pass has depth
+    gpu_queries::Settings querySettings;
+    if (const char *occlusion = optionValue(argc, argv, "--occlusion-culling")) {
+        querySettings.occlusionCulling = strcmp(occlusion, "on") == 0;
+    }
+    gpu_queries::configure(querySettings);
+
+    {
+        profiler::Scope scope("startup");
+        importMesh(argc, argv);
+
+        {
+            profiler::Scope scope("glfw::initialize");
+            // --windows <count> opens that many views of the scene, presented together
+            const char *windows = optionValue(argc, argv, "--windows");
+            // --headless on renders without a display, e.g. on lavapipe in CI; pair it with --frames
+            const char *headless = optionValue(argc, argv, "--headless");
+            glfw::initialize(windows != nullptr ? std::max(1u, (uint32_t)strtoul(windows, nullptr, 10)) : 1,
+                             headless != nullptr && strcmp(headless, "on") == 0);
+        }
+        vulkan::initialize();
+
+        vulkan::setupScene();
+    }
 
-    glfw::initialize();
-    vulkan::initialize();
+    render_thread::start();
 
-    vulkan::setupScene();
+    // --frames <count> renders a fixed number of frames and exits; 0 runs until the window closes
+    const char *frames = optionValue(argc, argv, "--frames");
+    const uint64_t maxFrames = frames != nullptr ? strtoull(frames, nullptr, 10) : 0;
 
-    while (!glfw::shouldCloseWindow()) {
+    vulkan::FrameState state;
+    bool pendingState = false;
+    while (!glfw::shouldCloseWindow() && (maxFrames == 0 || state.frameNumber < maxFrames || pendingState)) {
         glfw::pollEvents();
-        vulkan::drawFrame();
+
+        if (!pendingState) {
+            // simulate the next frame while the render thread works on the current one
+            std::pair<double, double> cursor = glfw::cursorPosition();
+            state.frameNumber++;
+            state.time = glfw::time();
+            std::pair<double, double> pixelScale = glfw::pixelScale();
+            state.cursorX = cursor.first;
+            state.cursorY = cursor.second;
+            state.pixelScaleX = pixelScale.first;
+            state.pixelScaleY = pixelScale.second;
+            pendingState = true;
+        }
+
+        if (render_thread::submit(state)) {
+            pendingState = false;
+        } else {
+            glfw::waitEvents(kEventWaitTimeout);
+        }
+    }
+
+    render_thread::stop();
+    frame_stats::logSummary();
+    // --stats <file> also writes the timings out, for the regression tests
+    const char *statsPath = optionValue(argc, argv, "--stats");
+    if (statsPath != nullptr) {
+        frame_stats::writeSummary(statsPath);
     }
 
     vulkan::tearDownScene();
 
     vulkan::shutdown();
     glfw::shutdown();
+    thread_pool::stop();
+
+    if (tracePath != nullptr) {
+        profiler::writeTrace(tracePath);
+    }
 
     return 0;
 }
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. Move-only; unmaps on destruction.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    ~MappedFile();
+
+    // returns false and stays unmapped if the file can't be opened or mapped
+    bool open(const std::string &path);
+    void close();
+
+    const char *data() const { return _data; }
+    size_t size() const { return _size; }
+    bool isOpen() const { return _data != nullptr; }
+
+private:
+    const char *_data = nullptr;
+    size_t _size = 0;
+};
@@ -0,0 +1,1678 @@
+#include "mesh_loader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <utility>
+
+#include "thread_pool.hpp"
+
+namespace {
+    using mesh_loader::Mesh;
+    using mesh_loader::Submesh;
+    using mesh_loader::Vertex;
+
+    const char kCacheMagic[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+    const uint32_t kCacheVersion = 1;
+    // satisfies every buffer offset alignment a device can ask for
+    const uint64_t kCacheAlignment = 256;
+
+    const size_t kObjChunkSize = 4 << 20;
+    const unsigned kVertexCacheSize = 16;
+    // submeshes are optimized in independent blocks so large ones spread over the pool
+    const size_t kOptimizeBlockTriangles = 1 << 18;
+    // clusters are split where their running miss ratio drops within this factor of the whole cluster's
+    const float kOverdrawThreshold = 1.05f;
+
+    struct CacheHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertexSize;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t submeshCount;
+        uint32_t reserved;
+        float boundsMin[3];
+        float boundsMax[3];
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint64_t submeshOffset;
+        uint64_t fileSize;
+    };
+
+    bool hasExtension(const std::string &path, const char *extension) {
+        size_t length = strlen(extension);
+        if (path.size() < length) {
+            return false;
+        }
+        for (size_t i = 0; i < length; ++i) {
+            if (tolower((unsigned char)path[path.size() - length + i]) != extension[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    uint64_t hashBytes(const void *data, size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char*>(data);
+        uint64_t h = 0x9e3779b97f4a7c15ull;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, bytes + i, 8);
+            h = mix(h ^ word);
+        }
+        for (; i < size; ++i) {
+            h = mix(h ^ bytes[i]);
+        }
+        return h;
+    }
+
+    // ---- deduplication ----
+
+    // maps every item to a unique id; `firstItems[id]` is the first item with that id.
+    // Items are bucketed by hash so each bucket can be deduplicated on its own thread.
+    template<typename Hash, typename Equal>
+    void deduplicate(size_t count, Hash hash, Equal equal, std::vector<uint32_t> &remap, std::vector<uint32_t> &firstItems) {
+        std::vector<uint64_t> hashes(count);
+        thread_pool::parallelFor(count, 4096, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                hashes[i] = hash(i);
+            }
+        });
+
+        const size_t partitionCount = std::max<size_t>(1, thread_pool::concurrency() * 2);
+        auto partitionOf = [&](size_t item) { return (size_t)((hashes[item] >> 32) % partitionCount); };
+
+        // counting sort into partitions, keeping item order within each
+        const size_t rangeCount = std::max<size_t>(1, std::min<size_t>(thread_pool::concurrency() * 4, count / 4096 + 1));
+        const size_t rangeSize = (count + rangeCount - 1) / rangeCount;
+        std::vector<size_t> counts(rangeCount * partitionCount, 0);
+        thread_pool::parallelFor(rangeCount, 1, [&](size_t begin, size_t end) {
+            for (size_t range = begin; range < end; ++range) {
+                for (size_t i = range * rangeSize; i < std::min(count, (range + 1) * rangeSize); ++i) {
+                    counts[range * partitionCount + partitionOf(i)]++;
+                }
+            }
+        });
+        std::vector<size_t> partitionStart(partitionCount + 1, 0);
+        std::vector<size_t> offsets(rangeCount * partitionCount);
+        size_t running = 0;
+        for (size_t p = 0; p < partitionCount; ++p) {
+            partitionStart[p] = running;
+            for (size_t range = 0; range < rangeCount; ++range) {
+                offsets[range * partitionCount + p] = running;
+                running += counts[range * partitionCount + p];
+            }
+        }
+        partitionStart[partitionCount] = running;
+
+        std::vector<uint32_t> ordered(count);
+        thread_pool::parallelFor(rangeCount, 1, [&](size_t begin, size_t end) {
+            for (size_t range = begin; range < end; ++range) {
+                size_t *offset = &offsets[range * partitionCount];
+                for (size_t i = range * rangeSize; i < std::min(count, (range + 1) * rangeSize); ++i) {
+                    ordered[offset[partitionOf(i)]++] = (uint32_t)i;
+                }
+            }
+        });
+
+        remap.assign(count, 0);
+        std::vector<std::vector<uint32_t>> partitionFirsts(partitionCount);
+        thread_pool::parallelFor(partitionCount, 1, [&](size_t begin, size_t end) {
+            std::vector<uint32_t> table;
+            for (size_t p = begin; p < end; ++p) {
+                size_t items = partitionStart[p + 1] - partitionStart[p];
+                size_t capacity = 16;
+                while (capacity < items * 2) {
+                    capacity *= 2;
+                }
+                const size_t mask = capacity - 1;
+                table.assign(capacity, UINT32_MAX);
+                std::vector<uint32_t> &firsts = partitionFirsts[p];
+
+                for (size_t n = partitionStart[p]; n < partitionStart[p + 1]; ++n) {
+                    uint32_t item = ordered[n];
+                    size_t slot = hashes[item] & mask;
+                    for (;;) {
+                        uint32_t id = table[slot];
+                        if (id == UINT32_MAX) {
+                            table[slot] = (uint32_t)firsts.size();
+                            remap[item] = (uint32_t)firsts.size();
+                            firsts.push_back(item);
+                            break;
+                        }
+                        uint32_t first = firsts[id];
+                        if (hashes[first] == hashes[item] && equal(first, item)) {
+                            remap[item] = id;
+                            break;
+                        }
+                        slot = (slot + 1) & mask;
+                    }
+                }
+            }
+        });
+
+        std::vector<uint32_t> partitionBase(partitionCount, 0);
+        size_t uniqueCount = 0;
+        for (size_t p = 0; p < partitionCount; ++p) {
+            partitionBase[p] = (uint32_t)uniqueCount;
+            uniqueCount += partitionFirsts[p].size();
+        }
+        firstItems.resize(uniqueCount);
+        thread_pool::parallelFor(partitionCount, 1, [&](size_t begin, size_t end) {
+            for (size_t p = begin; p < end; ++p) {
+                std::copy(partitionFirsts[p].begin(), partitionFirsts[p].end(), firstItems.begin() + partitionBase[p]);
+            }
+        });
+        thread_pool::parallelFor(count, 4096, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                remap[i] += partitionBase[partitionOf(i)];
+            }
+        });
+    }
+
+    void computeBounds(Mesh &mesh) {
+        if (mesh.vertices.empty()) {
+            return;
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            mesh.boundsMin[axis] = mesh.boundsMax[axis] = mesh.vertices[0].position[axis];
+        }
+        for (const Vertex &vertex : mesh.vertices) {
+            for (int axis = 0; axis < 3; ++axis) {
+                mesh.boundsMin[axis] = std::min(mesh.boundsMin[axis], vertex.position[axis]);
+                mesh.boundsMax[axis] = std::max(mesh.boundsMax[axis], vertex.position[axis]);
+            }
+        }
+    }
+
+    void generateNormals(Mesh &mesh, const std::vector<bool> &needsNormal) {
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            const uint32_t *triangle = &mesh.indices[i];
+            const float *a = mesh.vertices[triangle[0]].position;
+            const float *b = mesh.vertices[triangle[1]].position;
+            const float *c = mesh.vertices[triangle[2]].position;
+            float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            // area weighted
+            float normal[3] = {
+                ab[1] * ac[2] - ab[2] * ac[1],
+                ab[2] * ac[0] - ab[0] * ac[2],
+                ab[0] * ac[1] - ab[1] * ac[0],
+            };
+            for (int corner = 0; corner < 3; ++corner) {
+                if (needsNormal[triangle[corner]]) {
+                    float *target = mesh.vertices[triangle[corner]].normal;
+                    target[0] += normal[0];
+                    target[1] += normal[1];
+                    target[2] += normal[2];
+                }
+            }
+        }
+        for (size_t v = 0; v < mesh.vertices.size(); ++v) {
+            if (!needsNormal[v]) {
+                continue;
+            }
+            float *normal = mesh.vertices[v].normal;
+            float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if (length > 0.0f) {
+                normal[0] /= length;
+                normal[1] /= length;
+                normal[2] /= length;
+            }
+        }
+    }
+
+    // ---- text parsing ----
+
+    const double kPowersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char *skipSpaces(const char *p, const char *end) {
+        while (p < end && isSpace(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    // locale independent and much faster than strtod; returns nullptr if there's no number
+    const char *parseNumber(const char *p, const char *end, double &value) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            ++p;
+        }
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        int digits = 0;
+        bool any = false;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits += mantissa != 0;
+            } else {
+                ++exponent;
+            }
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p, any = true) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                    digits += mantissa != 0;
+                    --exponent;
+                }
+            }
+        }
+        if (!any) {
+            return nullptr;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char *q = p + 1;
+            bool negativeExponent = false;
+            if (q < end && (*q == '-' || *q == '+')) {
+                negativeExponent = *q == '-';
+                ++q;
+            }
+            if (q < end && *q >= '0' && *q <= '9') {
+                int explicitExponent = 0;
+                for (; q < end && *q >= '0' && *q <= '9'; ++q) {
+                    explicitExponent = std::min(explicitExponent * 10 + (*q - '0'), 9999);
+                }
+                exponent += negativeExponent ? -explicitExponent : explicitExponent;
+                p = q;
+            }
+        }
+        double result = (double)mantissa;
+        if (exponent < 0) {
+            result = -exponent <= 22 ? result / kPowersOf10[-exponent] : result * std::pow(10.0, exponent);
+        } else if (exponent > 0) {
+            result = exponent <= 22 ? result * kPowersOf10[exponent] : result * std::pow(10.0, exponent);
+        }
+        value = negative ? -result : result;
+        return p;
+    }
+
+    const char *parseInteger(const char *p, const char *end, int64_t &value) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            ++p;
+        }
+        if (p >= end || *p < '0' || *p > '9') {
+            return nullptr;
+        }
+        int64_t result = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            result = result * 10 + (*p - '0');
+        }
+        value = negative ? -result : result;
+        return p;
+    }
+
+    // ---- OBJ ----
+
+    // face indices are stored before the chunk's global offsets are known:
+    // positive OBJ indices are global already, negative ones are relative to
+    // the chunk's own counts and get biased so they can be told apart
+    const int64_t kMissingIndex = -1;
+    const int64_t kInvalidIndex = -2;
+    const int64_t kRelativeBias = (int64_t)1 << 40;
+    const int64_t kRelativeLimit = -((int64_t)1 << 39);
+
+    struct ObjChunk {
+        std::vector<float> positions; // xyz
+        std::vector<float> uvs;       // uv
+        std::vector<float> normals;   // xyz
+        std::vector<int64_t> corners; // position, uv, normal per triangle corner
+        std::vector<size_t> groupStarts; // local triangle index of each o/g/usemtl
+        size_t positionBase = 0;
+        size_t uvBase = 0;
+        size_t normalBase = 0;
+        size_t cornerBase = 0;
+    };
+
+    int64_t encodeObjIndex(int64_t index, size_t localCount) {
+        if (index > 0) {
+            return index - 1;
+        }
+        if (index < 0) {
+            return (int64_t)localCount + index - kRelativeBias;
+        }
+        return kInvalidIndex;
+    }
+
+    bool resolveObjIndex(int64_t encoded, size_t base, size_t total, uint32_t &resolved) {
+        if (encoded == kMissingIndex) {
+            resolved = UINT32_MAX;
+            return true;
+        }
+        int64_t index = encoded < kRelativeLimit ? (int64_t)base + encoded + kRelativeBias : encoded;
+        if (index < 0 || (uint64_t)index >= total) {
+            return false;
+        }
+        resolved = (uint32_t)index;
+        return true;
+    }
+
+    const char *parseFloats(const char *p, const char *end, float *values, int count) {
+        for (int i = 0; i < count; ++i) {
+            double value;
+            const char *next = parseNumber(skipSpaces(p, end), end, value);
+            if (next == nullptr) {
+                return i == 0 ? nullptr : p;
+            }
+            values[i] = (float)value;
+            p = next;
+        }
+        return p;
+    }
+
+    void parseObjFace(const char *p, const char *end, ObjChunk &chunk) {
+        int64_t first[3];
+        int64_t previous[3];
+        int cornerCount = 0;
+        for (;;) {
+            p = skipSpaces(p, end);
+            if (p >= end) {
+                break;
+            }
+            int64_t corner[3] = { kInvalidIndex, kMissingIndex, kMissingIndex };
+            int64_t index;
+            const char *next = parseInteger(p, end, index);
+            if (next == nullptr) {
+                break;
+            }
+            corner[0] = encodeObjIndex(index, chunk.positions.size() / 3);
+            p = next;
+            if (p < end && *p == '/') {
+                ++p;
+                if ((next = parseInteger(p, end, index)) != nullptr) {
+                    corner[1] = encodeObjIndex(index, chunk.uvs.size() / 2);
+                    p = next;
+                }
+                if (p < end && *p == '/') {
+                    ++p;
+                    if ((next = parseInteger(p, end, index)) != nullptr) {
+                        corner[2] = encodeObjIndex(index, chunk.normals.size() / 3);
+                        p = next;
+                    }
+                }
+            }
+            // skip anything unexpected up to the next separator
+            while (p < end && !isSpace(*p)) {
+                ++p;
+            }
+
+            if (cornerCount == 0) {
+                std::copy(corner, corner + 3, first);
+            } else if (cornerCount >= 2) {
+                // fan triangulation of polygons
+                chunk.corners.insert(chunk.corners.end(), first, first + 3);
+                chunk.corners.insert(chunk.corners.end(), previous, previous + 3);
+                chunk.corners.insert(chunk.corners.end(), corner, corner + 3);
+            }
+            std::copy(corner, corner + 3, previous);
+            ++cornerCount;
+        }
+    }
+
+    void parseObjChunk(const char *p, const char *end, ObjChunk &chunk) {
+        while (p < end) {
+            const char *lineEnd = static_cast<const char*>(memchr(p, '\n', (size_t)(end - p)));
+            if (lineEnd == nullptr) {
+                lineEnd = end;
+            }
+            const char *line = skipSpaces(p, lineEnd);
+            size_t length = (size_t)(lineEnd - line);
+
+            if (length >= 2 && line[0] == 'v' && isSpace(line[1])) {
+                float position[3] = { 0.0f, 0.0f, 0.0f };
+                parseFloats(line + 2, lineEnd, position, 3);
+                chunk.positions.insert(chunk.positions.end(), position, position + 3);
+            } else if (length >= 3 && line[0] == 'v' && line[1] == 't' && isSpace(line[2])) {
+                float uv[2] = { 0.0f, 0.0f };
+                parseFloats(line + 3, lineEnd, uv, 2);
+                // OBJ puts the origin at the bottom left, Vulkan and glTF at the top left
+                uv[1] = 1.0f - uv[1];
+                chunk.uvs.insert(chunk.uvs.end(), uv, uv + 2);
+            } else if (length >= 3 && line[0] == 'v' && line[1] == 'n' && isSpace(line[2])) {
+                float normal[3] = { 0.0f, 0.0f, 0.0f };
+                parseFloats(line + 3, lineEnd, normal, 3);
+                chunk.normals.insert(chunk.normals.end(), normal, normal + 3);
+            } else if (length >= 2 && line[0] == 'f' && isSpace(line[1])) {
+                parseObjFace(line + 2, lineEnd, chunk);
+            } else if ((length >= 2 && (line[0] == 'o' || line[0] == 'g') && isSpace(line[1])) ||
+                       (length >= 7 && strncmp(line, "usemtl", 6) == 0 && isSpace(line[6]))) {
+                chunk.groupStarts.push_back(chunk.corners.size() / 9);
+            }
+            p = lineEnd + 1;
+        }
+    }
+
+    // ---- JSON ----
+
+    struct JsonValue {
+        enum class Type { Null, Bool, Number, String, Array, Object };
+
+        Type type = Type::Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string string;
+        std::vector<JsonValue> elements;
+        std::vector<std::pair<std::string, JsonValue>> members;
+
+        const JsonValue *find(const char *key) const {
+            for (const auto &member : members) {
+                if (member.first == key) {
+                    return &member.second;
+                }
+            }
+            return nullptr;
+        }
+
+        double numberOr(const char *key, double fallback) const {
+            const JsonValue *value = find(key);
+            return value != nullptr && value->type == Type::Number ? value->number : fallback;
+        }
+
+        // JSON numbers are doubles; anything negative or fractional is no index
+        const JsonValue *element(double index) const {
+            bool valid = type == Type::Array && index >= 0.0 && index < (double)elements.size() && index == std::floor(index);
+            return valid ? &elements[(size_t)index] : nullptr;
+        }
+    };
+
+    const int kMaxJsonDepth = 64;
+
+    const char *skipJsonSpaces(const char *p, const char *end) {
+        while (p < end && (isSpace(*p) || *p == '\n')) {
+            ++p;
+        }
+        return p;
+    }
+
+    void appendUtf8(std::string &out, uint32_t codepoint) {
+        if (codepoint < 0x80) {
+            out += (char)codepoint;
+        } else if (codepoint < 0x800) {
+            out += (char)(0xc0 | (codepoint >> 6));
+            out += (char)(0x80 | (codepoint & 0x3f));
+        } else {
+            out += (char)(0xe0 | (codepoint >> 12));
+            out += (char)(0x80 | ((codepoint >> 6) & 0x3f));
+            out += (char)(0x80 | (codepoint & 0x3f));
+        }
+    }
+
+    const char *parseJsonString(const char *p, const char *end, std::string &out) {
+        // p is past the opening quote
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                out += *p++;
+                continue;
+            }
+            if (++p >= end) {
+                return nullptr;
+            }
+            char escaped = *p++;
+            switch (escaped) {
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    if (end - p < 4) {
+                        return nullptr;
+                    }
+                    uint32_t codepoint = 0;
+                    for (int i = 0; i < 4; ++i, ++p) {
+                        char c = *p;
+                        uint32_t digit = c >= '0' && c <= '9' ? (uint32_t)(c - '0')
+                                       : c >= 'a' && c <= 'f' ? (uint32_t)(c - 'a' + 10)
+                                       : c >= 'A' && c <= 'F' ? (uint32_t)(c - 'A' + 10)
+                                       : 16;
+                        if (digit == 16) {
+                            return nullptr;
+                        }
+                        codepoint = codepoint * 16 + digit;
+                    }
+                    // surrogate pairs aren't combined; glTF keys and names we look at are ASCII
+                    appendUtf8(out, codepoint);
+                    break;
+                }
+                default: out += escaped; break;
+            }
+        }
+        return p < end ? p + 1 : nullptr;
+    }
+
+    const char *parseJson(const char *p, const char *end, JsonValue &value, int depth) {
+        p = skipJsonSpaces(p, end);
+        if (p >= end || depth > kMaxJsonDepth) {
+            return nullptr;
+        }
+        switch (*p) {
+            case '{': {
+                value.type = JsonValue::Type::Object;
+                p = skipJsonSpaces(p + 1, end);
+                if (p < end && *p == '}') {
+                    return p + 1;
+                }
+                for (;;) {
+                    p = skipJsonSpaces(p, end);
+                    if (p >= end || *p != '"') {
+                        return nullptr;
+                    }
+                    value.members.emplace_back();
+                    auto &member = value.members.back();
+                    p = parseJsonString(p + 1, end, member.first);
+                    if (p == nullptr) {
+                        return nullptr;
+                    }
+                    p = skipJsonSpaces(p, end);
+                    if (p >= end || *p != ':') {
+                        return nullptr;
+                    }
+                    p = parseJson(p + 1, end, member.second, depth + 1);
+                    if (p == nullptr) {
+                        return nullptr;
+                    }
+                    p = skipJsonSpaces(p, end);
+                    if (p < end && *p == ',') {
+                        ++p;
+                    } else if (p < end && *p == '}') {
+                        return p + 1;
+                    } else {
+                        return nullptr;
+                    }
+                }
+            }
+            case '[': {
+                value.type = JsonValue::Type::Array;
+                p = skipJsonSpaces(p + 1, end);
+                if (p < end && *p == ']') {
+                    return p + 1;
+                }
+                for (;;) {
+                    value.elements.emplace_back();
+                    p = parseJson(p, end, value.elements.back(), depth + 1);
+                    if (p == nullptr) {
+                        return nullptr;
+                    }
+                    p = skipJsonSpaces(p, end);
+                    if (p < end && *p == ',') {
+                        ++p;
+                    } else if (p < end && *p == ']') {
+                        return p + 1;
+                    } else {
+                        return nullptr;
+                    }
+                }
+            }
+            case '"':
+                value.type = JsonValue::Type::String;
+                return parseJsonString(p + 1, end, value.string);
+            case 't':
+            case 'f':
+            case 'n': {
+                const char *literal = *p == 't' ? "true" : *p == 'f' ? "false" : "null";
+                size_t length = strlen(literal);
+                if ((size_t)(end - p) < length || strncmp(p, literal, length) != 0) {
+                    return nullptr;
+                }
+                value.type = *p == 'n' ? JsonValue::Type::Null : JsonValue::Type::Bool;
+                value.boolean = *p == 't';
+                return p + length;
+            }
+            default:
+                value.type = JsonValue::Type::Number;
+                return parseNumber(p, end, value.number);
+        }
+    }
+
+    // ---- glTF ----
+
+    const uint32_t kGlbMagic = 0x46546c67;      // "glTF"
+    const uint32_t kGlbChunkJson = 0x4e4f534a;  // "JSON"
+    const uint32_t kGlbChunkBinary = 0x004e4942; // "BIN\0"
+    const int kModeTriangles = 4;
+
+    enum ComponentType {
+        Byte = 5120,
+        UnsignedByte = 5121,
+        Short = 5122,
+        UnsignedShort = 5123,
+        UnsignedInt = 5125,
+        Float = 5126,
+    };
+
+    struct Gltf {
+        JsonValue json;
+        const char *binary = nullptr;
+        size_t binarySize = 0;
+    };
+
+    struct Accessor {
+        const char *data = nullptr;
+        size_t stride = 0;
+        size_t count = 0;
+        int componentType = 0;
+        int components = 0;
+        bool normalized = false;
+    };
+
+    // column major like glTF
+    struct Matrix {
+        float m[16];
+    };
+
+    Matrix identity() {
+        Matrix result = {};
+        result.m[0] = result.m[5] = result.m[10] = result.m[15] = 1.0f;
+        return result;
+    }
+
+    Matrix multiply(const Matrix &a, const Matrix &b) {
+        Matrix result;
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; ++k) {
+                    sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+                }
+                result.m[column * 4 + row] = sum;
+            }
+        }
+        return result;
+    }
+
+    size_t componentSize(int componentType) {
+        switch (componentType) {
+            case Byte:
+            case UnsignedByte: return 1;
+            case Short:
+            case UnsignedShort: return 2;
+            case UnsignedInt:
+            case Float: return 4;
+            default: return 0;
+        }
+    }
+
+    int componentCount(const std::string &type) {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        return 0;
+    }
+
+    bool readAccessor(const Gltf &gltf, double index, Accessor &accessor) {
+        const JsonValue *accessors = gltf.json.find("accessors");
+        const JsonValue *bufferViews = gltf.json.find("bufferViews");
+        const JsonValue *json = accessors != nullptr ? accessors->element(index) : nullptr;
+        if (json == nullptr || json->find("sparse") != nullptr) {
+            return false;
+        }
+        const JsonValue *type = json->find("type");
+        const JsonValue *normalized = json->find("normalized");
+        accessor.componentType = (int)json->numberOr("componentType", 0);
+        accessor.components = type != nullptr ? componentCount(type->string) : 0;
+        accessor.normalized = normalized != nullptr && normalized->boolean;
+        double elementSize = (double)(componentSize(accessor.componentType) * (size_t)accessor.components);
+        if (elementSize == 0) {
+            return false;
+        }
+
+        const JsonValue *view = bufferViews != nullptr ? bufferViews->element(json->numberOr("bufferView", -1)) : nullptr;
+        if (view == nullptr || view->numberOr("buffer", 0) != 0) {
+            return false;
+        }
+        // range checks in doubles, which hold any size a file can have exactly, so nothing wraps
+        double count = json->numberOr("count", 0);
+        double offset = json->numberOr("byteOffset", 0);
+        double viewOffset = view->numberOr("byteOffset", 0);
+        double viewLength = view->numberOr("byteLength", 0);
+        double stride = view->numberOr("byteStride", elementSize);
+        if (count < 0 || offset < 0 || viewOffset < 0 || viewLength < 0 || stride < elementSize) {
+            return false;
+        }
+        if (viewOffset + viewLength > (double)gltf.binarySize || (count > 0 && offset + stride * (count - 1) + elementSize > viewLength)) {
+            return false;
+        }
+        accessor.count = (size_t)count;
+        accessor.stride = (size_t)stride;
+        accessor.data = gltf.binary + (size_t)viewOffset + (size_t)offset;
+        return true;
+    }
+
+    void readFloats(const Accessor &accessor, size_t index, float *out, int count) {
+        const char *element = accessor.data + index * accessor.stride;
+        for (int c = 0; c < count; ++c) {
+            float value = 0.0f;
+            if (c < accessor.components) {
+                switch (accessor.componentType) {
+                    case Float: memcpy(&value, element + c * 4, 4); break;
+                    case UnsignedByte: {
+                        uint8_t v = (uint8_t)element[c];
+                        value = accessor.normalized ? v / 255.0f : (float)v;
+                        break;
+                    }
+                    case Byte: {
+                        int8_t v = (int8_t)element[c];
+                        value = accessor.normalized ? std::max(v / 127.0f, -1.0f) : (float)v;
+                        break;
+                    }
+                    case UnsignedShort: {
+                        uint16_t v;
+                        memcpy(&v, element + c * 2, 2);
+                        value = accessor.normalized ? v / 65535.0f : (float)v;
+                        break;
+                    }
+                    case Short: {
+                        int16_t v;
+                        memcpy(&v, element + c * 2, 2);
+                        value = accessor.normalized ? std::max(v / 32767.0f, -1.0f) : (float)v;
+                        break;
+                    }
+                    default: break;
+                }
+            }
+            out[c] = value;
+        }
+    }
+
+    uint32_t readIndex(const Accessor &accessor, size_t index) {
+        const char *element = accessor.data + index * accessor.stride;
+        switch (accessor.componentType) {
+            case UnsignedByte: return (uint8_t)element[0];
+            case UnsignedShort: {
+                uint16_t value;
+                memcpy(&value, element, 2);
+                return value;
+            }
+            default: {
+                uint32_t value;
+                memcpy(&value, element, 4);
+                return value;
+            }
+        }
+    }
+
+    Matrix nodeTransform(const JsonValue &node) {
+        Matrix result = identity();
+        const JsonValue *matrix = node.find("matrix");
+        if (matrix != nullptr && matrix->elements.size() == 16) {
+            for (int i = 0; i < 16; ++i) {
+                result.m[i] = (float)matrix->elements[i].number;
+            }
+            return result;
+        }
+        float t[3] = { 0.0f, 0.0f, 0.0f };
+        float r[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        float s[3] = { 1.0f, 1.0f, 1.0f };
+        const JsonValue *translation = node.find("translation");
+        const JsonValue *rotation = node.find("rotation");
+        const JsonValue *scale = node.find("scale");
+        for (int i = 0; i < 3 && translation != nullptr && i < (int)translation->elements.size(); ++i) {
+            t[i] = (float)translation->elements[i].number;
+        }
+        for (int i = 0; i < 4 && rotation != nullptr && i < (int)rotation->elements.size(); ++i) {
+            r[i] = (float)rotation->elements[i].number;
+        }
+        for (int i = 0; i < 3 && scale != nullptr && i < (int)scale->elements.size(); ++i) {
+            s[i] = (float)scale->elements[i].number;
+        }
+        float x = r[0], y = r[1], z = r[2], w = r[3];
+        float rotationMatrix[9] = {
+            1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+            2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+            2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y),
+        };
+        // T * R * S
+        for (int column = 0; column < 3; ++column) {
+            for (int row = 0; row < 3; ++row) {
+                result.m[column * 4 + row] = rotationMatrix[column * 3 + row] * s[column];
+            }
+        }
+        result.m[12] = t[0];
+        result.m[13] = t[1];
+        result.m[14] = t[2];
+        return result;
+    }
+
+    struct Primitive {
+        const JsonValue *json;
+        Matrix world;
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        size_t vertexBase = 0;
+        size_t indexBase = 0;
+        // without a NORMAL attribute normals are generated after deduplication, as for OBJ
+        bool hasNormals = false;
+    };
+
+    void collectPrimitives(const Gltf &gltf, double nodeIndex, const Matrix &parent, int depth, std::vector<Primitive> &primitives) {
+        const JsonValue *nodes = gltf.json.find("nodes");
+        const JsonValue *node = nodes != nullptr ? nodes->element(nodeIndex) : nullptr;
+        if (node == nullptr || depth > kMaxJsonDepth) {
+            return;
+        }
+        Matrix world = multiply(parent, nodeTransform(*node));
+
+        const JsonValue *meshes = gltf.json.find("meshes");
+        const JsonValue *meshIndex = node->find("mesh");
+        const JsonValue *mesh = meshes != nullptr && meshIndex != nullptr ? meshes->element(meshIndex->number) : nullptr;
+        const JsonValue *meshPrimitives = mesh != nullptr ? mesh->find("primitives") : nullptr;
+        if (meshPrimitives != nullptr) {
+            for (const JsonValue &json : meshPrimitives->elements) {
+                if ((int)json.numberOr("mode", kModeTriangles) != kModeTriangles) {
+                    continue;
+                }
+                Primitive primitive;
+                primitive.json = &json;
+                primitive.world = world;
+                primitives.push_back(primitive);
+            }
+        }
+
+        const JsonValue *children = node->find("children");
+        if (children != nullptr) {
+            for (const JsonValue &child : children->elements) {
+                collectPrimitives(gltf, child.number, world, depth + 1, primitives);
+            }
+        }
+    }
+
+    std::vector<double> sceneRoots(const Gltf &gltf) {
+        std::vector<double> roots;
+        const JsonValue *scenes = gltf.json.find("scenes");
+        const JsonValue *scene = scenes != nullptr ? scenes->element(gltf.json.numberOr("scene", 0)) : nullptr;
+        const JsonValue *sceneNodes = scene != nullptr ? scene->find("nodes") : nullptr;
+        if (sceneNodes != nullptr) {
+            for (const JsonValue &node : sceneNodes->elements) {
+                roots.push_back(node.number);
+            }
+            return roots;
+        }
+        // no scene: every node that isn't someone's child
+        const JsonValue *nodes = gltf.json.find("nodes");
+        size_t nodeCount = nodes != nullptr ? nodes->elements.size() : 0;
+        std::vector<bool> isChild(nodeCount, false);
+        for (size_t i = 0; i < nodeCount; ++i) {
+            const JsonValue *children = nodes->elements[i].find("children");
+            for (size_t c = 0; children != nullptr && c < children->elements.size(); ++c) {
+                if (nodes->element(children->elements[c].number) != nullptr) {
+                    isChild[(size_t)children->elements[c].number] = true;
+                }
+            }
+        }
+        for (size_t i = 0; i < nodeCount; ++i) {
+            if (!isChild[i]) {
+                roots.push_back((double)i);
+            }
+        }
+        return roots;
+    }
+
+    bool decodePrimitive(const Gltf &gltf, const Primitive &primitive, Vertex *vertices, uint32_t *indices) {
+        const JsonValue *attributes = primitive.json->find("attributes");
+        Accessor positions, normals, uvs, indexAccessor;
+        if (!readAccessor(gltf, attributes->numberOr("POSITION", -1), positions)) {
+            return false;
+        }
+        bool hasNormals = primitive.hasNormals && readAccessor(gltf, attributes->numberOr("NORMAL", -1), normals);
+        bool hasUvs = readAccessor(gltf, attributes->numberOr("TEXCOORD_0", -1), uvs) && uvs.count == positions.count;
+
+        const float *m = primitive.world.m;
+        // cofactors of the upper 3x3 transform normals correctly under non-uniform scale
+        float normalMatrix[9] = {
+            m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+            m[2] * m[9] - m[1] * m[10], m[0] * m[10] - m[2] * m[8], m[1] * m[8] - m[0] * m[9],
+            m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4],
+        };
+        float determinant = m[0] * normalMatrix[0] + m[4] * normalMatrix[3] + m[8] * normalMatrix[6];
+
+        for (size_t i = 0; i < positions.count; ++i) {
+            Vertex &vertex = vertices[i];
+            float p[3], n[3] = { 0.0f, 0.0f, 0.0f };
+            readFloats(positions, i, p, 3);
+            for (int row = 0; row < 3; ++row) {
+                vertex.position[row] = m[row] * p[0] + m[4 + row] * p[1] + m[8 + row] * p[2] + m[12 + row];
+            }
+            if (hasNormals) {
+                readFloats(normals, i, n, 3);
+            }
+            // left zero for generateNormals() to accumulate into
+            float length = 0.0f;
+            for (int row = 0; row < 3; ++row) {
+                vertex.normal[row] = normalMatrix[row] * n[0] + normalMatrix[3 + row] * n[1] + normalMatrix[6 + row] * n[2];
+                length += vertex.normal[row] * vertex.normal[row];
+            }
+            length = length > 0.0f ? std::sqrt(length) * (determinant < 0.0f ? -1.0f : 1.0f) : 1.0f;
+            for (int row = 0; row < 3; ++row) {
+                vertex.normal[row] /= length;
+            }
+            if (hasUvs) {
+                readFloats(uvs, i, vertex.uv, 2);
+            } else {
+                vertex.uv[0] = vertex.uv[1] = 0.0f;
+            }
+        }
+
+        const JsonValue *indexJson = primitive.json->find("indices");
+        bool indexed = indexJson != nullptr;
+        if (indexed && (!readAccessor(gltf, indexJson->number, indexAccessor) || indexAccessor.components != 1)) {
+            return false;
+        }
+        // glTF allows only unsigned indices; readIndex() reads anything else as 4 bytes
+        if (indexed && indexAccessor.componentType != UnsignedByte && indexAccessor.componentType != UnsignedShort
+            && indexAccessor.componentType != UnsignedInt) {
+            return false;
+        }
+        size_t triangleCount = primitive.indexCount / 3;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            uint32_t corner[3];
+            for (int c = 0; c < 3; ++c) {
+                corner[c] = indexed ? readIndex(indexAccessor, t * 3 + c) : (uint32_t)(t * 3 + c);
+                if (corner[c] >= positions.count) {
+                    return false;
+                }
+            }
+            // mirrored transforms flip the winding
+            if (determinant < 0.0f) {
+                std::swap(corner[1], corner[2]);
+            }
+            for (int c = 0; c < 3; ++c) {
+                indices[t * 3 + c] = (uint32_t)primitive.vertexBase + corner[c];
+            }
+        }
+        return true;
+    }
+
+    // ---- optimization ----
+
+    // post-transform FIFO cache model
+    struct VertexCache {
+        std::vector<size_t> insertedAt;
+        size_t misses;
+
+        explicit VertexCache(size_t vertexCount) : insertedAt(vertexCount, 0), misses(kVertexCacheSize) {}
+
+        // returns true on a miss; a vertex is evicted once kVertexCacheSize others were inserted after it
+        bool access(uint32_t v) {
+            if (misses - insertedAt[v] < kVertexCacheSize) {
+                return false;
+            }
+            insertedAt[v] = ++misses;
+            return true;
+        }
+
+        void flush() {
+            misses += kVertexCacheSize;
+        }
+    };
+
+    // vertices transformed per triangle; 0.5 is ideal for large meshes, 3 means no reuse
+    float simulateCache(const uint32_t *indices, size_t indexCount, VertexCache &cache) {
+        if (indexCount < 3) {
+            return 0.0f;
+        }
+        cache.flush();
+        size_t before = cache.misses;
+        for (size_t i = 0; i < indexCount; ++i) {
+            cache.access(indices[i]);
+        }
+        return (float)(cache.misses - before) / (float)(indexCount / 3);
+    }
+
+    // Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality
+    // and Reduced Overdraw" (2007). Works on block-local vertex ids.
+    void tipsify(const std::vector<uint32_t> &indices, size_t vertexCount, std::vector<uint32_t> &order, std::vector<bool> &hardBoundary) {
+        const size_t triangleCount = indices.size() / 3;
+
+        std::vector<uint32_t> liveTriangles(vertexCount, 0);
+        for (uint32_t v : indices) {
+            liveTriangles[v]++;
+        }
+        std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+        }
+        std::vector<uint32_t> adjacency(indices.size());
+        std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            for (int c = 0; c < 3; ++c) {
+                adjacency[fill[indices[t * 3 + c]]++] = (uint32_t)t;
+            }
+        }
+
+        std::vector<size_t> cacheTime(vertexCount, 0);
+        std::vector<char> emitted(triangleCount, 0);
+        std::vector<uint32_t> deadEnds;
+        std::vector<uint32_t> candidates;
+        size_t time = kVertexCacheSize + 1;
+        size_t cursor = 0;
+        int64_t fanning = 0;
+        bool restarted = true;
+
+        order.clear();
+        hardBoundary.clear();
+        while (fanning >= 0) {
+            candidates.clear();
+            for (uint32_t a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; ++a) {
+                uint32_t t = adjacency[a];
+                if (emitted[t]) {
+                    continue;
+                }
+                order.push_back(t);
+                hardBoundary.push_back(restarted);
+                restarted = false;
+                for (int c = 0; c < 3; ++c) {
+                    uint32_t v = indices[t * 3 + c];
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (time - cacheTime[v] > kVertexCacheSize) {
+                        cacheTime[v] = time++;
+                    }
+                }
+                emitted[t] = 1;
+            }
+
+            // prefer the candidate still in cache that will be used up soonest
+            int64_t best = -1;
+            int64_t bestPriority = -1;
+            for (uint32_t v : candidates) {
+                if (liveTriangles[v] == 0) {
+                    continue;
+                }
+                int64_t priority = 0;
+                if (time - cacheTime[v] + 2 * liveTriangles[v] <= kVertexCacheSize) {
+                    priority = (int64_t)(time - cacheTime[v]);
+                }
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    best = v;
+                }
+            }
+            if (best < 0) {
+                // dead end: back up through recently used vertices, then scan forward
+                while (!deadEnds.empty() && best < 0) {
+                    uint32_t v = deadEnds.back();
+                    deadEnds.pop_back();
+                    if (liveTriangles[v] > 0) {
+                        best = v;
+                    }
+                }
+                while (best < 0 && cursor < vertexCount) {
+                    if (liveTriangles[cursor] > 0) {
+                        best = (int64_t)cursor;
+                        restarted = true;
+                    }
+                    ++cursor;
+                }
+            }
+            fanning = best;
+        }
+    }
+
+    // reorders one block of triangles in place; vertex ids are global
+    void optimizeBlock(const std::vector<Vertex> &vertices, uint32_t *indices, size_t indexCount, const float center[3]) {
+        const size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2) {
+            return;
+        }
+
+        // compact to block-local vertex ids: sort (id, slot) pairs and number the runs
+        std::vector<uint64_t> slots(indexCount);
+        for (size_t i = 0; i < indexCount; ++i) {
+            slots[i] = (uint64_t)indices[i] << 32 | i;
+        }
+        std::sort(slots.begin(), slots.end());
+        std::vector<uint32_t> globalIds;
+        std::vector<uint32_t> local(indexCount);
+        for (uint64_t slot : slots) {
+            uint32_t id = (uint32_t)(slot >> 32);
+            if (globalIds.empty() || globalIds.back() != id) {
+                globalIds.push_back(id);
+            }
+            local[(uint32_t)slot] = (uint32_t)globalIds.size() - 1;
+        }
+
+        std::vector<uint32_t> order;
+        std::vector<bool> hardBoundary;
+        tipsify(local, globalIds.size(), order, hardBoundary);
+
+        std::vector<uint32_t> sorted(indexCount);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            std::copy(&local[order[t] * 3], &local[order[t] * 3] + 3, &sorted[t * 3]);
+        }
+
+        // soft boundaries: split hard clusters where the running miss ratio is
+        // already close to the cluster's, so splitting costs little cache efficiency
+        VertexCache cache(globalIds.size());
+        std::vector<size_t> clusterStarts;
+        for (size_t start = 0; start < triangleCount;) {
+            size_t end = start + 1;
+            while (end < triangleCount && !hardBoundary[end]) {
+                ++end;
+            }
+            float clusterRatio = simulateCache(&sorted[start * 3], (end - start) * 3, cache);
+            cache.flush();
+            size_t runStart = start;
+            size_t runMisses = 0;
+            clusterStarts.push_back(start);
+            for (size_t t = start; t < end; ++t) {
+                for (int c = 0; c < 3; ++c) {
+                    runMisses += cache.access(sorted[t * 3 + c]) ? 1 : 0;
+                }
+                size_t runTriangles = t + 1 - runStart;
+                if (t + 1 < end && runTriangles >= 8 && (float)runMisses / runTriangles <= clusterRatio * kOverdrawThreshold) {
+                    // the next cluster may be drawn after anything, so it starts cold
+                    clusterStarts.push_back(t + 1);
+                    cache.flush();
+                    runStart = t + 1;
+                    runMisses = 0;
+                }
+            }
+            start = end;
+        }
+        clusterStarts.push_back(triangleCount);
+
+        // outward facing clusters far from the center tend to occlude the rest, so draw them first
+        const size_t clusterCount = clusterStarts.size() - 1;
+        std::vector<float> sortKey(clusterCount);
+        for (size_t cluster = 0; cluster < clusterCount; ++cluster) {
+            float centroid[3] = { 0.0f, 0.0f, 0.0f };
+            float normal[3] = { 0.0f, 0.0f, 0.0f };
+            float area = 0.0f;
+            for (size_t t = clusterStarts[cluster]; t < clusterStarts[cluster + 1]; ++t) {
+                const float *a = vertices[globalIds[sorted[t * 3 + 0]]].position;
+                const float *b = vertices[globalIds[sorted[t * 3 + 1]]].position;
+                const float *c = vertices[globalIds[sorted[t * 3 + 2]]].position;
+                float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+                float n[3] = {
+                    ab[1] * ac[2] - ab[2] * ac[1],
+                    ab[2] * ac[0] - ab[0] * ac[2],
+                    ab[0] * ac[1] - ab[1] * ac[0],
+                };
+                float triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int axis = 0; axis < 3; ++axis) {
+                    centroid[axis] += (a[axis] + b[axis] + c[axis]) * triangleArea / 3.0f;
+                    normal[axis] += n[axis];
+                }
+                area += triangleArea;
+            }
+            float key = 0.0f;
+            if (area > 0.0f) {
+                float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                for (int axis = 0; axis < 3; ++axis) {
+                    key += (centroid[axis] / area - center[axis]) * (length > 0.0f ? normal[axis] / length : 0.0f);
+                }
+            }
+            sortKey[cluster] = key;
+        }
+        std::vector<uint32_t> clusterOrder(clusterCount);
+        std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+        std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&sortKey](uint32_t a, uint32_t b) {
+            return sortKey[a] > sortKey[b];
+        });
+
+        uint32_t *out = indices;
+        for (uint32_t cluster : clusterOrder) {
+            for (size_t i = clusterStarts[cluster] * 3; i < clusterStarts[cluster + 1] * 3; ++i) {
+                *out++ = globalIds[sorted[i]];
+            }
+        }
+    }
+
+    void finishImport(Mesh &mesh) {
+        computeBounds(mesh);
+        mesh_loader::optimize(mesh);
+    }
+}
+
+namespace mesh_loader {
+    bool load(const std::string &path, Mesh &mesh) {
+        if (hasExtension(path, ".obj")) {
+            return loadObj(path, mesh);
+        }
+        if (hasExtension(path, ".glb")) {
+            return loadGlb(path, mesh);
+        }
+        std::cerr << "[mesh] " << path << ": unsupported format" << std::endl;
+        return false;
+    }
+
+    bool loadObj(const std::string &path, Mesh &mesh) {
+        MappedFile file;
+        if (!file.open(path)) {
+            std::cerr << "[mesh] " << path << ": can't open" << std::endl;
+            return false;
+        }
+
+        // split at line breaks into chunks that parse independently
+        std::vector<std::pair<const char*, const char*>> ranges;
+        const char *fileEnd = file.data() + file.size();
+        for (const char *p = file.data(); p < fileEnd;) {
+            const char *chunkEnd = p + std::min(kObjChunkSize, (size_t)(fileEnd - p));
+            if (chunkEnd < fileEnd) {
+                const char *lineEnd = static_cast<const char*>(memchr(chunkEnd, '\n', (size_t)(fileEnd - chunkEnd)));
+                chunkEnd = lineEnd != nullptr ? lineEnd + 1 : fileEnd;
+            }
+            ranges.emplace_back(p, chunkEnd);
+            p = chunkEnd;
+        }
+
+        std::vector<ObjChunk> chunks(ranges.size());
+        thread_pool::parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                parseObjChunk(ranges[i].first, ranges[i].second, chunks[i]);
+            }
+        });
+
+        size_t positionCount = 0, uvCount = 0, normalCount = 0, cornerCount = 0;
+        for (ObjChunk &chunk : chunks) {
+            chunk.positionBase = positionCount;
+            chunk.uvBase = uvCount;
+            chunk.normalBase = normalCount;
+            chunk.cornerBase = cornerCount;
+            positionCount += chunk.positions.size() / 3;
+            uvCount += chunk.uvs.size() / 2;
+            normalCount += chunk.normals.size() / 3;
+            cornerCount += chunk.corners.size() / 3;
+        }
+        if (cornerCount == 0 || cornerCount > UINT32_MAX || positionCount >= UINT32_MAX) {
+            std::cerr << "[mesh] " << path << ": no triangles or too many to index with 32 bits" << std::endl;
+            return false;
+        }
+
+        std::vector<float> positions(positionCount * 3), uvs(uvCount * 2), normals(normalCount * 3);
+        std::vector<uint32_t> keys(cornerCount * 3);
+        std::atomic<bool> invalid(false);
+        thread_pool::parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                ObjChunk &chunk = chunks[i];
+                std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionBase * 3);
+                std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + chunk.uvBase * 2);
+                std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalBase * 3);
+                uint32_t *key = &keys[chunk.cornerBase * 3];
+                for (size_t c = 0; c < chunk.corners.size(); c += 3, key += 3) {
+                    if (!resolveObjIndex(chunk.corners[c + 0], chunk.positionBase, positionCount, key[0]) ||
+                        !resolveObjIndex(chunk.corners[c + 1], chunk.uvBase, uvCount, key[1]) ||
+                        !resolveObjIndex(chunk.corners[c + 2], chunk.normalBase, normalCount, key[2])) {
+                        invalid = true;
+                    }
+                }
+                // the corners aren't needed any more
+                std::vector<int64_t>().swap(chunk.corners);
+            }
+        });
+        if (invalid) {
+            std::cerr << "[mesh] " << path << ": face index out of range" << std::endl;
+            return false;
+        }
+
+        std::vector<uint32_t> remap, firstCorners;
+        deduplicate(cornerCount,
+            [&keys](size_t corner) { return hashBytes(&keys[corner * 3], sizeof(uint32_t) * 3); },
+            [&keys](size_t a, size_t b) { return memcmp(&keys[a * 3], &keys[b * 3], sizeof(uint32_t) * 3) == 0; },
+            remap, firstCorners);
+
+        mesh = Mesh();
+        mesh.vertices.resize(firstCorners.size());
+        std::atomic<bool> missingNormals(false);
+        thread_pool::parallelFor(firstCorners.size(), 4096, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v) {
+                const uint32_t *key = &keys[firstCorners[v] * 3];
+                Vertex &vertex = mesh.vertices[v];
+                std::copy(&positions[key[0] * 3], &positions[key[0] * 3] + 3, vertex.position);
+                if (key[1] != UINT32_MAX) {
+                    std::copy(&uvs[key[1] * 2], &uvs[key[1] * 2] + 2, vertex.uv);
+                } else {
+                    vertex.uv[0] = vertex.uv[1] = 0.0f;
+                }
+                if (key[2] != UINT32_MAX) {
+                    std::copy(&normals[key[2] * 3], &normals[key[2] * 3] + 3, vertex.normal);
+                } else {
+                    vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
+                    missingNormals = true;
+                }
+            }
+        });
+        mesh.indices = std::move(remap);
+
+        if (missingNormals) {
+            std::vector<bool> needsNormal(mesh.vertices.size());
+            for (size_t v = 0; v < mesh.vertices.size(); ++v) {
+                needsNormal[v] = keys[firstCorners[v] * 3 + 2] == UINT32_MAX;
+            }
+            generateNormals(mesh, needsNormal);
+        }
+
+        // one submesh per non-empty o/g/usemtl group
+        std::vector<size_t> groupStarts(1, 0);
+        for (const ObjChunk &chunk : chunks) {
+            for (size_t start : chunk.groupStarts) {
+                groupStarts.push_back(chunk.cornerBase / 3 + start);
+            }
+        }
+        groupStarts.push_back(cornerCount / 3);
+        for (size_t g = 0; g + 1 < groupStarts.size(); ++g) {
+            if (groupStarts[g + 1] > groupStarts[g]) {
+                mesh.submeshes.push_back({ (uint32_t)(groupStarts[g] * 3), (uint32_t)((groupStarts[g + 1] - groupStarts[g]) * 3) });
+            }
+        }
+
+        finishImport(mesh);
+        return true;
+    }
+
+    bool loadGlb(const std::string &path, Mesh &mesh) {
+        MappedFile file;
+        if (!file.open(path)) {
+            std::cerr << "[mesh] " << path << ": can't open" << std::endl;
+            return false;
+        }
+
+        uint32_t header[3];
+        if (file.size() < sizeof(header)) {
+            std::cerr << "[mesh] " << path << ": not a binary glTF file" << std::endl;
+            return false;
+        }
+        memcpy(header, file.data(), sizeof(header));
+        if (header[0] != kGlbMagic || header[1] != 2 || header[2] > file.size()) {
+            std::cerr << "[mesh] " << path << ": not a binary glTF 2.0 file" << std::endl;
+            return false;
+        }
+
+        Gltf gltf;
+        const char *json = nullptr;
+        size_t jsonSize = 0;
+        for (size_t offset = sizeof(header); offset + 8 <= header[2];) {
+            uint32_t chunk[2];
+            memcpy(chunk, file.data() + offset, sizeof(chunk));
+            offset += sizeof(chunk);
+            if (chunk[0] > header[2] - offset) {
+                break;
+            }
+            if (chunk[1] == kGlbChunkJson && json == nullptr) {
+                json = file.data() + offset;
+                jsonSize = chunk[0];
+            } else if (chunk[1] == kGlbChunkBinary && gltf.binary == nullptr) {
+                gltf.binary = file.data() + offset;
+                gltf.binarySize = chunk[0];
+            }
+            // chunks are 4 byte aligned
+            offset += (chunk[0] + 3) & ~3u;
+        }
+        if (json == nullptr || parseJson(json, json + jsonSize, gltf.json, 0) == nullptr) {
+            std::cerr << "[mesh] " << path << ": invalid glTF JSON" << std::endl;
+            return false;
+        }
+        const JsonValue *buffers = gltf.json.find("buffers");
+        const JsonValue *firstBuffer = buffers != nullptr ? buffers->element(0) : nullptr;
+        if (firstBuffer != nullptr && firstBuffer->find("uri") != nullptr) {
+            std::cerr << "[mesh] " << path << ": external buffers aren't supported" << std::endl;
+            return false;
+        }
+
+        std::vector<Primitive> primitives;
+        for (double root : sceneRoots(gltf)) {
+            collectPrimitives(gltf, root, identity(), 0, primitives);
+        }
+
+        size_t vertexCount = 0, indexCount = 0;
+        for (Primitive &primitive : primitives) {
+            const JsonValue *attributes = primitive.json->find("attributes");
+            Accessor positions, normals, indices;
+            if (attributes == nullptr || !readAccessor(gltf, attributes->numberOr("POSITION", -1), positions)) {
+                std::cerr << "[mesh] " << path << ": primitive without valid positions" << std::endl;
+                return false;
+            }
+            primitive.hasNormals = readAccessor(gltf, attributes->numberOr("NORMAL", -1), normals) && normals.count == positions.count;
+            const JsonValue *indexJson = primitive.json->find("indices");
+            primitive.vertexCount = positions.count;
+            primitive.indexCount = indexJson != nullptr && readAccessor(gltf, indexJson->number, indices) ? indices.count : positions.count;
+            primitive.indexCount -= primitive.indexCount % 3;
+            primitive.vertexBase = vertexCount;
+            primitive.indexBase = indexCount;
+            vertexCount += primitive.vertexCount;
+            indexCount += primitive.indexCount;
+        }
+        if (indexCount == 0 || indexCount > UINT32_MAX || vertexCount >= UINT32_MAX) {
+            std::cerr << "[mesh] " << path << ": no triangles or too many to index with 32 bits" << std::endl;
+            return false;
+        }
+
+        std::vector<Vertex> vertices(vertexCount);
+        std::vector<uint32_t> indices(indexCount);
+        std::atomic<bool> invalid(false);
+        thread_pool::parallelFor(primitives.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const Primitive &primitive = primitives[i];
+                if (!decodePrimitive(gltf, primitive, &vertices[primitive.vertexBase], &indices[primitive.indexBase])) {
+                    invalid = true;
+                }
+            }
+        });
+        if (invalid) {
+            std::cerr << "[mesh] " << path << ": invalid accessor or index data" << std::endl;
+            return false;
+        }
+
+        // exporters often split vertices that turn out identical after transforming
+        std::vector<uint32_t> remap, firstVertices;
+        deduplicate(vertexCount,
+            [&vertices](size_t v) { return hashBytes(&vertices[v], sizeof(Vertex)); },
+            [&vertices](size_t a, size_t b) { return memcmp(&vertices[a], &vertices[b], sizeof(Vertex)) == 0; },
+            remap, firstVertices);
+
+        mesh = Mesh();
+        mesh.vertices.resize(firstVertices.size());
+        thread_pool::parallelFor(firstVertices.size(), 4096, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v) {
+                mesh.vertices[v] = vertices[firstVertices[v]];
+            }
+        });
+        thread_pool::parallelFor(indexCount, 4096, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                indices[i] = remap[indices[i]];
+            }
+        });
+        mesh.indices = std::move(indices);
+        for (const Primitive &primitive : primitives) {
+            if (primitive.indexCount > 0) {
+                mesh.submeshes.push_back({ (uint32_t)primitive.indexBase, (uint32_t)primitive.indexCount });
+            }
+        }
+
+        bool missingNormals = false;
+        for (const Primitive &primitive : primitives) {
+            missingNormals = missingNormals || !primitive.hasNormals;
+        }
+        if (missingNormals) {
+            std::vector<bool> needsNormal(mesh.vertices.size());
+            for (const Primitive &primitive : primitives) {
+                if (!primitive.hasNormals) {
+                    for (size_t v = primitive.vertexBase; v < primitive.vertexBase + primitive.vertexCount; ++v) {
+                        needsNormal[remap[v]] = true;
+                    }
+                }
+            }
+            generateNormals(mesh, needsNormal);
+        }
+
+        finishImport(mesh);
+        return true;
+    }
+
+    void optimize(Mesh &mesh) {
+        float center[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            center[axis] = (mesh.boundsMin[axis] + mesh.boundsMax[axis]) * 0.5f;
+        }
+
+        std::vector<std::pair<size_t, size_t>> blocks;
+        for (const Submesh &submesh : mesh.submeshes) {
+            for (size_t offset = 0; offset < submesh.indexCount; offset += kOptimizeBlockTriangles * 3) {
+                blocks.emplace_back(submesh.indexOffset + offset, std::min<size_t>(kOptimizeBlockTriangles * 3, submesh.indexCount - offset));
+            }
+        }
+        thread_pool::parallelFor(blocks.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; ++b) {
+                optimizeBlock(mesh.vertices, &mesh.indices[blocks[b].first], blocks[b].second, center);
+            }
+        });
+
+        // vertices in first-use order so fetches walk memory forwards
+        std::vector<uint32_t> newIds(mesh.vertices.size(), UINT32_MAX);
+        uint32_t nextId = 0;
+        for (uint32_t &index : mesh.indices) {
+            if (newIds[index] == UINT32_MAX) {
+                newIds[index] = nextId++;
+            }
+            index = newIds[index];
+        }
+        std::vector<Vertex> reordered(nextId);
+        thread_pool::parallelFor(mesh.vertices.size(), 4096, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v) {
+                if (newIds[v] != UINT32_MAX) {
+                    reordered[newIds[v]] = mesh.vertices[v];
+                }
+            }
+        });
+        mesh.vertices.swap(reordered);
+    }
+
+    float cacheMissRatio(const Mesh &mesh) {
+        VertexCache cache(mesh.vertices.size());
+        return simulateCache(mesh.indices.data(), mesh.indices.size(), cache);
+    }
+
+    bool writeCache(const std::string &path, const Mesh &mesh) {
+        auto align = [](uint64_t offset) { return (offset + kCacheAlignment - 1) & ~(kCacheAlignment - 1); };
+
+        CacheHeader header = {};
+        memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+        header.version = kCacheVersion;
+        header.vertexSize = sizeof(Vertex);
+        header.vertexCount = (uint32_t)mesh.vertices.size();
+        header.indexCount = (uint32_t)mesh.indices.size();
+        header.submeshCount = (uint32_t)mesh.submeshes.size();
+        std::copy(mesh.boundsMin, mesh.boundsMin + 3, header.boundsMin);
+        std::copy(mesh.boundsMax, mesh.boundsMax + 3, header.boundsMax);
+        header.vertexOffset = align(sizeof(CacheHeader));
+        header.indexOffset = align(header.vertexOffset + sizeof(Vertex) * mesh.vertices.size());
+        header.submeshOffset = align(header.indexOffset + sizeof(uint32_t) * mesh.indices.size());
+        header.fileSize = header.submeshOffset + sizeof(Submesh) * mesh.submeshes.size();
+
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            std::cerr << "[mesh] " << path << ": can't write cache" << std::endl;
+            return false;
+        }
+        const char padding[kCacheAlignment] = {};
+        uint64_t written = 0;
+        auto write = [&](uint64_t offset, const void *data, size_t size) {
+            bool ok = offset >= written && fwrite(padding, 1, (size_t)(offset - written), file) == offset - written;
+            ok = ok && (size == 0 || fwrite(data, 1, size, file) == size);
+            written = offset + size;
+            return ok;
+        };
+        bool ok = write(0, &header, sizeof(header))
+            && write(header.vertexOffset, mesh.vertices.data(), sizeof(Vertex) * mesh.vertices.size())
+            && write(header.indexOffset, mesh.indices.data(), sizeof(uint32_t) * mesh.indices.size())
+            && write(header.submeshOffset, mesh.submeshes.data(), sizeof(Submesh) * mesh.submeshes.size());
+        ok = fclose(file) == 0 && ok;
+        if (!ok) {
+            std::cerr << "[mesh] " << path << ": failed writing cache" << std::endl;
+            remove(path.c_str());
+        }
+        return ok;
+    }
+
+    bool loadCache(const std::string &path, MeshView &view) {
+        MappedFile file;
+        if (!file.open(path)) {
+            std::cerr << "[mesh] " << path << ": can't open" << std::endl;
+            return false;
+        }
+        CacheHeader header;
+        if (file.size() < sizeof(header)) {
+            std::cerr << "[mesh] " << path << ": not a mesh cache" << std::endl;
+            return false;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        // a block fits in the file; compared without sums, which could wrap for hostile offsets
+        auto fits = [&header](uint64_t offset, uint64_t count, uint64_t size) {
+            return offset <= header.fileSize && count * size <= header.fileSize - offset;
+        };
+        // written in native byte order by a build with the same Vertex layout
+        bool valid = memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) == 0
+            && header.version == kCacheVersion
+            && header.vertexSize == sizeof(Vertex)
+            && header.fileSize == file.size()
+            && header.vertexOffset % kCacheAlignment == 0
+            && header.indexOffset % kCacheAlignment == 0
+            && header.submeshOffset % kCacheAlignment == 0
+            && header.vertexOffset >= sizeof(CacheHeader)
+            && fits(header.vertexOffset, header.vertexCount, sizeof(Vertex))
+            && fits(header.indexOffset, header.indexCount, sizeof(uint32_t))
+            && fits(header.submeshOffset, header.submeshCount, sizeof(Submesh))
+            && header.vertexOffset + (uint64_t)sizeof(Vertex) * header.vertexCount <= header.indexOffset
+            && header.indexOffset + (uint64_t)sizeof(uint32_t) * header.indexCount <= header.submeshOffset;
+        if (!valid) {
+            std::cerr << "[mesh] " << path << ": cache is stale or corrupt" << std::endl;
+            return false;
+        }
+
+        // ranges are drawn from as they are, so none may leave the blocks
+        const Submesh *submeshes = reinterpret_cast<const Submesh*>(file.data() + header.submeshOffset);
+        for (uint32_t i = 0; i < header.submeshCount && valid; ++i) {
+            valid = (uint64_t)submeshes[i].indexOffset + submeshes[i].indexCount <= header.indexCount;
+        }
+        const uint32_t *indices = reinterpret_cast<const uint32_t*>(file.data() + header.indexOffset);
+        for (uint32_t i = 0; i < header.indexCount && valid; ++i) {
+            valid = indices[i] < header.vertexCount;
+        }
+        if (!valid) {
+            std::cerr << "[mesh] " << path << ": cache has out of range submeshes or indices" << std::endl;
+            return false;
+        }
+
+        view.vertices = reinterpret_cast<const Vertex*>(file.data() + header.vertexOffset);
+        view.vertexCount = header.vertexCount;
+        view.indices = reinterpret_cast<const uint32_t*>(file.data() + header.indexOffset);
+        view.indexCount = header.indexCount;
+        view.submeshes = reinterpret_cast<const Submesh*>(file.data() + header.submeshOffset);
+        view.submeshCount = header.submeshCount;
+        std::copy(header.boundsMin, header.boundsMin + 3, view.boundsMin);
+        std::copy(header.boundsMax, header.boundsMax + 3, view.boundsMax);
+        view.file = std::move(file);
+        return true;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+// Imports triangle meshes from OBJ and binary glTF 2.0 (.glb), and reads and
+// writes a binary cache whose vertex and index blocks can be copied straight
+// into GPU buffers.
+namespace mesh_loader {
+    struct Vertex {
+        float position[3];
+        float normal[3];
+        float uv[2];
+    };
+
+    // a contiguous index range, one per glTF primitive or OBJ group
+    struct Submesh {
+        uint32_t indexOffset;
+        uint32_t indexCount;
+    };
+
+    struct Mesh {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<Submesh> submeshes;
+        float boundsMin[3] = { 0.0f, 0.0f, 0.0f };
+        float boundsMax[3] = { 0.0f, 0.0f, 0.0f };
+    };
+
+    // points into a mapped cache file; valid while the view is alive
+    struct MeshView {
+        const Vertex *vertices = nullptr;
+        uint32_t vertexCount = 0;
+        const uint32_t *indices = nullptr;
+        uint32_t indexCount = 0;
+        const Submesh *submeshes = nullptr;
+        uint32_t submeshCount = 0;
+        float boundsMin[3] = { 0.0f, 0.0f, 0.0f };
+        float boundsMax[3] = { 0.0f, 0.0f, 0.0f };
+        MappedFile file;
+    };
+
+    // picks the importer from the extension (.obj, .glb); the result is
+    // deduplicated and optimized. Uses thread_pool when it's running.
+    bool load(const std::string &path, Mesh &mesh);
+    bool loadObj(const std::string &path, Mesh &mesh);
+    bool loadGlb(const std::string &path, Mesh &mesh);
+
+    // reorders each submesh's triangles for post-transform vertex cache hits
+    // (Tipsify), then sorts triangle clusters to reduce overdraw, then
+    // renumbers vertices in first-use order for fetch locality
+    void optimize(Mesh &mesh);
+    // average vertices transformed per triangle with a 16 entry FIFO cache
+    float cacheMissRatio(const Mesh &mesh);
+
+    bool writeCache(const std::string &path, const Mesh &mesh);
+    bool loadCache(const std::string &path, MeshView &view);
+}
@@ -0,0 +1,339 @@
+#include "pipeline_cache.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "host_allocator.hpp"
+#include "vulkan_dispatch.hpp"
+#include "vulkan_handles.hpp"
+
+namespace {
+    using pipeline_cache::PipelineKey;
+
+    struct Entry {
+        uint64_t hash;
+        PipelineKey key;
+        handles::Pipeline pipeline;
+    };
+
+    // open addressing, insert only; slots are published with release stores so
+    // readers can probe without the lock while a writer fills other slots
+    struct Table {
+        size_t mask = 0;
+        size_t count = 0;
+        std::unique_ptr<std::atomic<const Entry*>[]> slots;
+    };
+
+    VkDevice _device = VK_NULL_HANDLE;
+    handles::PipelineCache _driverCache;
+
+    std::atomic<const Table*> _table(nullptr);
+
+    // guards everything below, and all writes to the current table
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<Entry>> _entries;
+    // the current table plus the ones it replaced, which readers may still be probing
+    std::vector<std::unique_ptr<Table>> _tables;
+
+    uint64_t mix(uint64_t h, uint64_t value) {
+        h ^= value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        return h;
+    }
+
+    const Entry *find(const Table *table, const PipelineKey &key, uint64_t hash) {
+        if (table == nullptr) {
+            return nullptr;
+        }
+        for (size_t slot = hash & table->mask;; slot = (slot + 1) & table->mask) {
+            const Entry *entry = table->slots[slot].load(std::memory_order_acquire);
+            if (entry == nullptr) {
+                return nullptr;
+            }
+            if (entry->hash == hash && entry->key == key) {
+                return entry;
+            }
+        }
+    }
+
+    void place(Table &table, const Entry *entry) {
+        size_t slot = entry->hash & table.mask;
+        while (table.slots[slot].load(std::memory_order_relaxed) != nullptr) {
+            slot = (slot + 1) & table.mask;
+        }
+        table.slots[slot].store(entry, std::memory_order_release);
+        table.count++;
+    }
+
+    // caller holds _mutex
+    void insert(const Entry *entry) {
+        Table *current = _tables.empty() ? nullptr : _tables.back().get();
+        // keep the load at or below one half so probes stay short
+        if (current == nullptr || (current->count + 1) * 2 > current->mask + 1) {
+            std::unique_ptr<Table> grown(new Table());
+            size_t capacity = current == nullptr ? 16 : (current->mask + 1) * 2;
+            grown->mask = capacity - 1;
+            grown->slots.reset(new std::atomic<const Entry*>[capacity]);
+            for (size_t i = 0; i < capacity; ++i) {
+                grown->slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+            for (const auto &existing : _entries) {
+                if (existing.get() != entry) {
+                    place(*grown, existing.get());
+                }
+            }
+            place(*grown, entry);
+            _table.store(grown.get(), std::memory_order_release);
+            _tables.push_back(std::move(grown));
+            return;
+        }
+        place(*current, entry);
+    }
+
+    handles::Pipeline createPipeline(const PipelineKey &key) {
+        // the key is const; info() needs somewhere to point
+        SpecializationConstants vertexConstants = key.vertexConstants;
+        SpecializationConstants fragmentConstants = key.fragmentConstants;
+
+        VkPipelineShaderStageCreateInfo stages[2] = {};
+        stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        stages[0].module = key.vertexShader;
+        stages[0].pName = "main";
+        stages[0].pSpecializationInfo = vertexConstants.info();
+        stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        stages[1].module = key.fragmentShader;
+        stages[1].pName = "main";
+        stages[1].pSpecializationInfo = fragmentConstants.info();
+
+        VkVertexInputBindingDescription bindingDescription = {};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = key.vertexStride;
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        if (key.attributeCount > 0) {
+            vertexInputInfo.vertexBindingDescriptionCount = 1;
+            vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+            vertexInputInfo.vertexAttributeDescriptionCount = key.attributeCount;
+            vertexInputInfo.pVertexAttributeDescriptions = key.attributes;
+        }
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = key.topology;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        // set with vkCmdSetViewport/vkCmdSetScissor
+        VkPipelineViewportStateCreateInfo viewportState = {};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer = {};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.polygonMode = key.polygonMode;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = key.cullMode;
+        rasterizer.frontFace = key.frontFace;
+
+        VkPipelineMultisampleStateCreateInfo multisampling = {};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.rasterizationSamples = key.samples;
+        multisampling.minSampleShading = 1.0f;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = key.depthTest ? VK_TRUE : VK_FALSE;
+        depthStencil.depthWriteEnable = key.depthWrite ? VK_TRUE : VK_FALSE;
+        depthStencil.depthCompareOp = key.depthCompareOp;
+        depthStencil.maxDepthBounds = 1.0f;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+        colorBlendAttachment.colorWriteMask = key.colorWriteMask;
+        colorBlendAttachment.blendEnable = key.blendEnable ? VK_TRUE : VK_FALSE;
+        colorBlendAttachment.srcColorBlendFactor = key.srcColorBlendFactor;
+        colorBlendAttachment.dstColorBlendFactor = key.dstColorBlendFactor;
+        colorBlendAttachment.colorBlendOp = key.colorBlendOp;
+        colorBlendAttachment.srcAlphaBlendFactor = key.srcAlphaBlendFactor;
+        colorBlendAttachment.dstAlphaBlendFactor = key.dstAlphaBlendFactor;
+        colorBlendAttachment.alphaBlendOp = key.alphaBlendOp;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending = {};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+
+        const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        VkPipelineDynamicStateCreateInfo dynamicState = {};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates = dynamicStates;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = stages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = key.layout;
+        pipelineInfo.renderPass = key.renderPass;
+        pipelineInfo.subpass = key.subpass;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        VkPipeline pipeline;
+        VkResult result = dispatch::device.vkCreateGraphicsPipelines(_device, _driverCache.get(), 1, &pipelineInfo, host_allocator::callbacks(), &pipeline);
+        assert(result == VK_SUCCESS);
+        return handles::Pipeline(_device, pipeline);
+    }
+}
+
+namespace pipeline_cache {
+    void PipelineKey::setShaders(const shader_module::ShaderObjects &shaders) {
+        vertexShader = shaders.module(VK_SHADER_STAGE_VERTEX_BIT);
+        fragmentShader = shaders.module(VK_SHADER_STAGE_FRAGMENT_BIT);
+        vertexConstants = shaders.constants(VK_SHADER_STAGE_VERTEX_BIT);
+        fragmentConstants = shaders.constants(VK_SHADER_STAGE_FRAGMENT_BIT);
+    }
+
+    void PipelineKey::addAttribute(uint32_t location, VkFormat format, uint32_t offset) {
+        assert(attributeCount < kMaxVertexAttributes);
+        attributes[attributeCount++] = { location, 0, format, offset };
+    }
+
+    void PipelineKey::setAlphaBlending() {
+        blendEnable = true;
+        srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        colorBlendOp = VK_BLEND_OP_ADD;
+        srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        alphaBlendOp = VK_BLEND_OP_ADD;
+    }
+
+    bool PipelineKey::operator==(const PipelineKey &other) const {
+        if (attributeCount != other.attributeCount) {
+            return false;
+        }
+        for (uint32_t i = 0; i < attributeCount; ++i) {
+            const VkVertexInputAttributeDescription &a = attributes[i];
+            const VkVertexInputAttributeDescription &b = other.attributes[i];
+            if (a.location != b.location || a.format != b.format || a.offset != b.offset) {
+                return false;
+            }
+        }
+        return vertexShader == other.vertexShader
+            && fragmentShader == other.fragmentShader
+            && layout == other.layout
+            && vertexStride == other.vertexStride
+            && topology == other.topology
+            && polygonMode == other.polygonMode
+            && cullMode == other.cullMode
+            && frontFace == other.frontFace
+            && blendEnable == other.blendEnable
+            && srcColorBlendFactor == other.srcColorBlendFactor
+            && dstColorBlendFactor == other.dstColorBlendFactor
+            && colorBlendOp == other.colorBlendOp
+            && srcAlphaBlendFactor == other.srcAlphaBlendFactor
+            && dstAlphaBlendFactor == other.dstAlphaBlendFactor
+            && alphaBlendOp == other.alphaBlendOp
+            && colorWriteMask == other.colorWriteMask
+            && depthTest == other.depthTest
+            && depthWrite == other.depthWrite
+            && depthCompareOp == other.depthCompareOp
+            && samples == other.samples
+            && renderPass == other.renderPass
+            && subpass == other.subpass
+            && vertexConstants == other.vertexConstants
+            && fragmentConstants == other.fragmentConstants;
+    }
+
+    uint64_t PipelineKey::hash() const {
+        // field by field, so padding never leaks in
+        uint64_t h = 0;
+        h = mix(h, (uint64_t)vertexShader);
+        h = mix(h, (uint64_t)fragmentShader);
+        h = mix(h, vertexConstants.hash());
+        h = mix(h, fragmentConstants.hash());
+        h = mix(h, (uint64_t)layout);
+        h = mix(h, vertexStride);
+        for (uint32_t i = 0; i < attributeCount; ++i) {
+            h = mix(h, ((uint64_t)attributes[i].location << 32) | (uint64_t)attributes[i].format);
+            h = mix(h, attributes[i].offset);
+        }
+        h = mix(h, ((uint64_t)topology << 32) | (uint64_t)polygonMode);
+        h = mix(h, ((uint64_t)cullMode << 32) | (uint64_t)frontFace);
+        h = mix(h, blendEnable ? ((uint64_t)srcColorBlendFactor << 48 | (uint64_t)dstColorBlendFactor << 32 | (uint64_t)colorBlendOp) : 0);
+        h = mix(h, blendEnable ? ((uint64_t)srcAlphaBlendFactor << 48 | (uint64_t)dstAlphaBlendFactor << 32 | (uint64_t)alphaBlendOp) : 0);
+        h = mix(h, ((uint64_t)colorWriteMask << 32) | (uint64_t)samples);
+        h = mix(h, ((uint64_t)depthTest << 33) | ((uint64_t)depthWrite << 32) | (uint64_t)depthCompareOp);
+        h = mix(h, (uint64_t)renderPass);
+        h = mix(h, subpass);
+        return h;
+    }
+
+    void initialize(VkDevice device) {
+        _device = device;
+
+        // lets the driver reuse compiled state between pipelines, e.g. shared shaders
+        VkPipelineCacheCreateInfo cacheInfo = {};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+        VkPipelineCache driverCache;
+        VkResult result = dispatch::device.vkCreatePipelineCache(_device, &cacheInfo, host_allocator::callbacks(), &driverCache);
+        assert(result == VK_SUCCESS);
+        _driverCache = handles::PipelineCache(_device, driverCache);
+    }
+
+    void shutdown() {
+        clear();
+        _driverCache.reset();
+        _device = VK_NULL_HANDLE;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _table.store(nullptr, std::memory_order_release);
+        _tables.clear();
+        // pipelines are destroyed once the frames that used them retire
+        _entries.clear();
+    }
+
+    VkPipeline get(const PipelineKey &key) {
+        const uint64_t hash = key.hash();
+        if (const Entry *entry = find(_table.load(std::memory_order_acquire), key, hash)) {
+            return entry->pipeline.get();
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        // another thread may have created it while we waited
+        if (const Entry *entry = find(_table.load(std::memory_order_relaxed), key, hash)) {
+            return entry->pipeline.get();
+        }
+        std::unique_ptr<Entry> entry(new Entry());
+        entry->hash = hash;
+        entry->key = key;
+        entry->pipeline = createPipeline(key);
+        _entries.push_back(std::move(entry));
+        insert(_entries.back().get());
+        return _entries.back()->pipeline.get();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entries.size();
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "include_vulkan.hpp"
+#include "shader_module.hpp"
+#include "specialization_constants.hpp"
+
+// Graphics pipelines looked up by the state they're built from. Identical
+// keys share one VkPipeline; lookups of existing pipelines don't lock, so they
+// are cheap enough to do while recording. Viewport and scissor are dynamic
+// state and not part of the key.
+namespace pipeline_cache {
+    const uint32_t kMaxVertexAttributes = 8;
+
+    struct PipelineKey {
+        // shader set
+        VkShaderModule vertexShader = VK_NULL_HANDLE;
+        VkShaderModule fragmentShader = VK_NULL_HANDLE;
+        SpecializationConstants vertexConstants;
+        SpecializationConstants fragmentConstants;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+
+        // vertex layout: one interleaved per-vertex binding, or none
+        uint32_t vertexStride = 0;
+        uint32_t attributeCount = 0;
+        VkVertexInputAttributeDescription attributes[kMaxVertexAttributes] = {};
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        // rasterization
+        VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+        VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+        VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+        // blending of the single color attachment
+        bool blendEnable = false;
+        VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+        VkBlendOp colorBlendOp = VK_BLEND_OP_ADD;
+        VkBlendFactor srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        VkBlendFactor dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        VkBlendOp alphaBlendOp = VK_BLEND_OP_ADD;
+        VkColorComponentFlags colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+        // depth, ignored by subpasses without a depth attachment
+        bool depthTest = false;
+        bool depthWrite = false;
+        VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+        // the pipeline can be used with any render pass compatible with this one
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        uint32_t subpass = 0;
+
+        void setShaders(const shader_module::ShaderObjects &shaders);
+        void addAttribute(uint32_t location, VkFormat format, uint32_t offset);
+        // straight alpha blending of color, premultiplied-style accumulation of alpha
+        void setAlphaBlending();
+
+        bool operator==(const PipelineKey &other) const;
+        uint64_t hash() const;
+    };
+
+    void initialize(VkDevice device);
+    void shutdown();
+    // releases every pipeline; nothing may be looking pipelines up meanwhile
+    void clear();
+
+    // an existing pipeline costs a hash probe without locking; a new one is
+    // created under a lock, once, no matter how many threads ask for it
+    VkPipeline get(const PipelineKey &key);
+    size_t size();
+}
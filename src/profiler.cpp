@@ -0,0 +1,206 @@
+#include "profiler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // blocks are allocated as a thread fills them; past the last one events are dropped
+    const size_t kBlockSize = 4096;
+    const size_t kMaxBlocks = 512;
+
+    struct Event {
+        const char *name;
+        int64_t begin;
+        int64_t end;
+    };
+
+    struct Block {
+        Event events[kBlockSize];
+    };
+
+    // written by its thread only; readers see every event below `count`
+    struct ThreadBuffer {
+        uint32_t id = 0;
+        std::string name;
+        std::atomic<Block*> blocks[kMaxBlocks];
+        std::atomic<size_t> count { 0 };
+        std::atomic<uint64_t> dropped { 0 };
+
+        ThreadBuffer() {
+            for (auto &block : blocks) {
+                block.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~ThreadBuffer() {
+            for (auto &block : blocks) {
+                delete block.load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::atomic<bool> _enabled { false };
+    Clock::time_point _start = Clock::now();
+
+    // guards the list and the names; buffers are never freed before exit, so
+    // the thread-local pointers stay valid
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> _buffers;
+    ThreadBuffer *_gpuBuffer = nullptr;
+
+    thread_local ThreadBuffer *_threadBuffer = nullptr;
+
+    // caller holds _mutex
+    ThreadBuffer *addBuffer(const std::string &name) {
+        _buffers.emplace_back(new ThreadBuffer());
+        ThreadBuffer *buffer = _buffers.back().get();
+        buffer->id = (uint32_t)_buffers.size();
+        buffer->name = name;
+        return buffer;
+    }
+
+    ThreadBuffer &threadBuffer() {
+        if (_threadBuffer == nullptr) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _threadBuffer = addBuffer("thread " + std::to_string(_buffers.size() + 1));
+        }
+        return *_threadBuffer;
+    }
+
+    void append(ThreadBuffer &buffer, const char *name, int64_t begin, int64_t end) {
+        const size_t index = buffer.count.load(std::memory_order_relaxed);
+        const size_t blockIndex = index / kBlockSize;
+        if (blockIndex >= kMaxBlocks) {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Block *block = buffer.blocks[blockIndex].load(std::memory_order_relaxed);
+        if (block == nullptr) {
+            block = new Block();
+            buffer.blocks[blockIndex].store(block, std::memory_order_release);
+        }
+        block->events[index % kBlockSize] = { name, begin, end };
+        buffer.count.store(index + 1, std::memory_order_release);
+    }
+
+    void writeString(FILE *file, const std::string &text) {
+        fputc('"', file);
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                fputc('\\', file);
+                fputc(c, file);
+            } else if ((unsigned char)c < 0x20) {
+                fprintf(file, "\\u%04x", (unsigned)c);
+            } else {
+                fputc(c, file);
+            }
+        }
+        fputc('"', file);
+    }
+}
+
+namespace profiler {
+    void start() {
+        _start = Clock::now();
+        _enabled.store(true, std::memory_order_release);
+    }
+
+    bool enabled() {
+        return _enabled.load(std::memory_order_acquire);
+    }
+
+    int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _start).count();
+    }
+
+    void setThreadName(const std::string &name) {
+        ThreadBuffer &buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(_mutex);
+        buffer.name = name;
+    }
+
+    Scope::~Scope() {
+        if (_name != nullptr) {
+            append(threadBuffer(), _name, _begin, now());
+        }
+    }
+
+    void gpuEvent(const char *name, int64_t begin, int64_t end) {
+        if (!enabled()) {
+            return;
+        }
+        ThreadBuffer *buffer;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_gpuBuffer == nullptr) {
+                _gpuBuffer = addBuffer("GPU");
+            }
+            buffer = _gpuBuffer;
+        }
+        append(*buffer, name, begin, end);
+    }
+
+    bool writeTrace(const std::string &path) {
+        FILE *file = fopen(path.c_str(), "w");
+        if (file == nullptr) {
+            std::cerr << "[profiler] " << path << ": can't write trace" << std::endl;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        size_t eventCount = 0;
+        uint64_t droppedCount = 0;
+        bool first = true;
+        auto separator = [&first, file] {
+            fputs(first ? "\n" : ",\n", file);
+            first = false;
+        };
+
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+        for (const auto &buffer : _buffers) {
+            separator();
+            fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", buffer->id);
+            writeString(file, buffer->name);
+            fputs("}}", file);
+            // threads in the order they showed up, the GPU last
+            separator();
+            fprintf(file, "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+                    buffer->id, buffer.get() == _gpuBuffer ? 1000000u : buffer->id);
+
+            const size_t count = buffer->count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < count; ++i) {
+                const Block *block = buffer->blocks[i / kBlockSize].load(std::memory_order_acquire);
+                const Event &event = block->events[i % kBlockSize];
+                separator();
+                fputs("{\"name\":", file);
+                writeString(file, event.name);
+                // microseconds, to the nanosecond
+                fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                        buffer->id, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+            }
+            eventCount += count;
+            droppedCount += buffer->dropped.load(std::memory_order_relaxed);
+        }
+        fputs("\n]}\n", file);
+
+        bool ok = ferror(file) == 0;
+        ok = fclose(file) == 0 && ok;
+        if (!ok) {
+            std::cerr << "[profiler] " << path << ": write failed" << std::endl;
+            return false;
+        }
+        std::cout << "[profiler] wrote " << eventCount << " events from " << _buffers.size() << " tracks to " << path;
+        if (droppedCount > 0) {
+            std::cout << ", " << droppedCount << " dropped";
+        }
+        std::cout << std::endl;
+        return true;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// CPU scope timings for every thread, plus a GPU track, written out as Chrome
+// trace-event JSON (chrome://tracing, ui.perfetto.dev). Each thread records
+// into its own buffer without locking; nothing is recorded until start().
+//
+// Event names are not copied: pass string literals or other strings that
+// outlive the trace.
+namespace profiler {
+    // call early in main(); timestamps are relative to this call
+    void start();
+    bool enabled();
+
+    // nanoseconds on the trace clock
+    int64_t now();
+
+    // labels the calling thread's track; the name is copied
+    void setThreadName(const std::string &name);
+
+    // times the enclosing block on the calling thread's track
+    class Scope {
+    public:
+        explicit Scope(const char *name) : _name(enabled() ? name : nullptr), _begin(_name != nullptr ? now() : 0) {}
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        const char *_name;
+        int64_t _begin;
+    };
+
+    // adds a span to the GPU track; times are on the trace clock. Call from
+    // one thread at a time
+    void gpuEvent(const char *name, int64_t begin, int64_t end);
+
+    // every event recorded so far; threads may keep recording meanwhile
+    bool writeTrace(const std::string &path);
+}
@@ -0,0 +1,79 @@
+#include "render_thread.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "glfw_integration.hpp"
+#include "profiler.hpp"
+#include "spsc_queue.hpp"
+
+namespace {
+    // one snapshot being simulated while the previous one is rendered
+    const size_t kQueueDepth = 2;
+
+    SpscQueue<vulkan::FrameState, kQueueDepth> _frameQueue;
+    std::atomic<bool> _running { false };
+    std::thread _thread;
+
+    // the queue itself never blocks; an idle render thread sleeps here until
+    // submit() or stop() has something for it
+    std::mutex _wakeMutex;
+    std::condition_variable _wakeCondition;
+    bool _wakePending = false;
+
+    void wakeRenderThread() {
+        {
+            std::lock_guard<std::mutex> lock(_wakeMutex);
+            _wakePending = true;
+        }
+        _wakeCondition.notify_one();
+    }
+
+    void renderLoop() {
+        profiler::setThreadName("render");
+        vulkan::FrameState state;
+        for (;;) {
+            if (!_frameQueue.pop(state)) {
+                // snapshots queued before stop() are still rendered
+                if (!_running.load(std::memory_order_acquire)) {
+                    break;
+                }
+                // a push between the failed pop and here leaves _wakePending set
+                std::unique_lock<std::mutex> lock(_wakeMutex);
+                _wakeCondition.wait(lock, []() { return _wakePending; });
+                _wakePending = false;
+                continue;
+            }
+            // a slot just freed up; let the main thread queue the next snapshot
+            glfw::wakeUp();
+            vulkan::drawFrame(state);
+        }
+    }
+}
+
+namespace render_thread {
+    void start() {
+        assert(!_running);
+        _running = true;
+        _thread = std::thread(renderLoop);
+    }
+
+    void stop() {
+        _running = false;
+        wakeRenderThread();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    bool submit(const vulkan::FrameState &state) {
+        if (!_frameQueue.push(state)) {
+            return false;
+        }
+        wakeRenderThread();
+        return true;
+    }
+}
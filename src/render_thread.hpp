@@ -0,0 +1,13 @@
+#pragma once
+
+#include "vulkan_integration.hpp"
+
+// Rendering and queue submission run on a dedicated thread; the main thread
+// keeps the GLFW event loop and hands over one state snapshot per frame.
+namespace render_thread {
+    void start();
+    void stop();
+
+    // returns false when the render thread is still busy with earlier frames
+    bool submit(const vulkan::FrameState &state);
+}
@@ -0,0 +1,451 @@
+#include "scene_objects.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+
+#include "thread_pool.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCENE_OBJECTS_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define SCENE_OBJECTS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+    using scene_objects::Frustum;
+
+    // arrays are padded to a multiple of the widest kernel so no kernel needs a tail loop
+    const size_t kLaneCount = 8;
+    // objects per culling task; a multiple of kLaneCount
+    const size_t kCullGrain = 4096;
+
+    const uint32_t kNoSlot = UINT32_MAX;
+
+    struct Soa {
+        std::vector<float> centerX, centerY, centerZ, radius;
+        std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+        size_t count = 0;
+
+        void resize(size_t newCount) {
+            size_t padded = (newCount + kLaneCount - 1) / kLaneCount * kLaneCount;
+            for (std::vector<float> *array : { &centerX, &centerY, &centerZ, &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) {
+                array->resize(padded, 0.0f);
+            }
+            // padding can't pass the sphere test
+            radius.resize(padded, -std::numeric_limits<float>::infinity());
+            // slots freed by a shrink that stay inside the padding; the rest went with the resize
+            for (size_t i = newCount; i < std::min(count, padded); ++i) {
+                radius[i] = -std::numeric_limits<float>::infinity();
+            }
+            count = newCount;
+        }
+
+        void set(size_t slot, const scene_objects::Bounds &bounds) {
+            centerX[slot] = bounds.center[0];
+            centerY[slot] = bounds.center[1];
+            centerZ[slot] = bounds.center[2];
+            radius[slot] = bounds.radius;
+            minX[slot] = bounds.min[0];
+            minY[slot] = bounds.min[1];
+            minZ[slot] = bounds.min[2];
+            maxX[slot] = bounds.max[0];
+            maxY[slot] = bounds.max[1];
+            maxZ[slot] = bounds.max[2];
+        }
+
+        void move(size_t from, size_t to) {
+            for (std::vector<float> *array : { &centerX, &centerY, &centerZ, &radius, &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) {
+                (*array)[to] = (*array)[from];
+            }
+        }
+    };
+
+    // per plane: the box corner furthest along the normal is the only one worth testing
+    struct PlaneArrays {
+        const float *x;
+        const float *y;
+        const float *z;
+    };
+
+    PlaneArrays positiveCorner(const Soa &soa, const float plane[4]) {
+        return {
+            plane[0] >= 0.0f ? soa.maxX.data() : soa.minX.data(),
+            plane[1] >= 0.0f ? soa.maxY.data() : soa.minY.data(),
+            plane[2] >= 0.0f ? soa.maxZ.data() : soa.minZ.data(),
+        };
+    }
+
+    // culls slots [begin, end), writes the visible ones to `out` and returns how many
+    using Kernel = size_t (*)(const Soa &soa, size_t begin, size_t end, const Frustum &frustum, uint32_t *out);
+
+    size_t cullScalar(const Soa &soa, size_t begin, size_t end, const Frustum &frustum, uint32_t *out) {
+        PlaneArrays corners[6];
+        for (int p = 0; p < 6; ++p) {
+            corners[p] = positiveCorner(soa, frustum.planes[p]);
+        }
+        size_t visible = 0;
+        for (size_t i = begin; i < end; ++i) {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; ++p) {
+                const float *plane = frustum.planes[p];
+                float sphere = plane[0] * soa.centerX[i] + plane[1] * soa.centerY[i] + plane[2] * soa.centerZ[i] + plane[3];
+                float box = plane[0] * corners[p].x[i] + plane[1] * corners[p].y[i] + plane[2] * corners[p].z[i] + plane[3];
+                inside = sphere >= -soa.radius[i] && box >= 0.0f;
+            }
+            out[visible] = (uint32_t)i;
+            visible += inside ? 1 : 0;
+        }
+        return visible;
+    }
+
+#if SCENE_OBJECTS_X86
+    size_t cullSse(const Soa &soa, size_t begin, size_t end, const Frustum &frustum, uint32_t *out) {
+        PlaneArrays corners[6];
+        __m128 planes[6][4];
+        for (int p = 0; p < 6; ++p) {
+            corners[p] = positiveCorner(soa, frustum.planes[p]);
+            for (int c = 0; c < 4; ++c) {
+                planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+            }
+        }
+        const __m128 zero = _mm_setzero_ps();
+        size_t visible = 0;
+        for (size_t i = begin; i < end; i += 4) {
+            __m128 cx = _mm_loadu_ps(&soa.centerX[i]);
+            __m128 cy = _mm_loadu_ps(&soa.centerY[i]);
+            __m128 cz = _mm_loadu_ps(&soa.centerZ[i]);
+            __m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(&soa.radius[i]));
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p) {
+                __m128 sphere = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], cx), _mm_mul_ps(planes[p][1], cy)),
+                                           _mm_add_ps(_mm_mul_ps(planes[p][2], cz), planes[p][3]));
+                __m128 box = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], _mm_loadu_ps(corners[p].x + i)),
+                                                   _mm_mul_ps(planes[p][1], _mm_loadu_ps(corners[p].y + i))),
+                                        _mm_add_ps(_mm_mul_ps(planes[p][2], _mm_loadu_ps(corners[p].z + i)), planes[p][3]));
+                inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(sphere, negativeRadius), _mm_cmpge_ps(box, zero)));
+            }
+            int mask = _mm_movemask_ps(inside);
+            while (mask != 0) {
+                int lane = __builtin_ctz((unsigned)mask);
+                out[visible++] = (uint32_t)(i + lane);
+                mask &= mask - 1;
+            }
+        }
+        return visible;
+    }
+
+    __attribute__((target("avx2,fma")))
+    size_t cullAvx2(const Soa &soa, size_t begin, size_t end, const Frustum &frustum, uint32_t *out) {
+        PlaneArrays corners[6];
+        __m256 planes[6][4];
+        for (int p = 0; p < 6; ++p) {
+            corners[p] = positiveCorner(soa, frustum.planes[p]);
+            for (int c = 0; c < 4; ++c) {
+                planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+            }
+        }
+        const __m256 zero = _mm256_setzero_ps();
+        size_t visible = 0;
+        for (size_t i = begin; i < end; i += 8) {
+            __m256 cx = _mm256_loadu_ps(&soa.centerX[i]);
+            __m256 cy = _mm256_loadu_ps(&soa.centerY[i]);
+            __m256 cz = _mm256_loadu_ps(&soa.centerZ[i]);
+            __m256 negativeRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&soa.radius[i]));
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p) {
+                __m256 sphere = _mm256_fmadd_ps(planes[p][0], cx, _mm256_fmadd_ps(planes[p][1], cy, _mm256_fmadd_ps(planes[p][2], cz, planes[p][3])));
+                __m256 box = _mm256_fmadd_ps(planes[p][0], _mm256_loadu_ps(corners[p].x + i),
+                             _mm256_fmadd_ps(planes[p][1], _mm256_loadu_ps(corners[p].y + i),
+                             _mm256_fmadd_ps(planes[p][2], _mm256_loadu_ps(corners[p].z + i), planes[p][3])));
+                inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(sphere, negativeRadius, _CMP_GE_OQ),
+                                                             _mm256_cmp_ps(box, zero, _CMP_GE_OQ)));
+            }
+            int mask = _mm256_movemask_ps(inside);
+            while (mask != 0) {
+                int lane = __builtin_ctz((unsigned)mask);
+                out[visible++] = (uint32_t)(i + lane);
+                mask &= mask - 1;
+            }
+        }
+        return visible;
+    }
+#endif
+
+#if SCENE_OBJECTS_NEON
+    size_t cullNeon(const Soa &soa, size_t begin, size_t end, const Frustum &frustum, uint32_t *out) {
+        PlaneArrays corners[6];
+        float32x4_t planes[6][4];
+        for (int p = 0; p < 6; ++p) {
+            corners[p] = positiveCorner(soa, frustum.planes[p]);
+            for (int c = 0; c < 4; ++c) {
+                planes[p][c] = vdupq_n_f32(frustum.planes[p][c]);
+            }
+        }
+        const float32x4_t zero = vdupq_n_f32(0.0f);
+        size_t visible = 0;
+        for (size_t i = begin; i < end; i += 4) {
+            float32x4_t cx = vld1q_f32(&soa.centerX[i]);
+            float32x4_t cy = vld1q_f32(&soa.centerY[i]);
+            float32x4_t cz = vld1q_f32(&soa.centerZ[i]);
+            float32x4_t negativeRadius = vnegq_f32(vld1q_f32(&soa.radius[i]));
+            uint32x4_t inside = vdupq_n_u32(UINT32_MAX);
+            for (int p = 0; p < 6; ++p) {
+                float32x4_t sphere = vmlaq_f32(vmlaq_f32(vmlaq_f32(planes[p][3], planes[p][2], cz), planes[p][1], cy), planes[p][0], cx);
+                float32x4_t box = vmlaq_f32(vmlaq_f32(vmlaq_f32(planes[p][3],
+                                      planes[p][2], vld1q_f32(corners[p].z + i)),
+                                      planes[p][1], vld1q_f32(corners[p].y + i)),
+                                      planes[p][0], vld1q_f32(corners[p].x + i));
+                inside = vandq_u32(inside, vandq_u32(vcgeq_f32(sphere, negativeRadius), vcgeq_f32(box, zero)));
+            }
+            uint32_t lanes[4];
+            vst1q_u32(lanes, inside);
+            for (int lane = 0; lane < 4; ++lane) {
+                out[visible] = (uint32_t)(i + lane);
+                visible += lanes[lane] != 0 ? 1 : 0;
+            }
+        }
+        return visible;
+    }
+#endif
+
+    struct KernelChoice {
+        Kernel kernel;
+        const char *name;
+    };
+
+    KernelChoice selectKernel() {
+#if SCENE_OBJECTS_X86
+        // may run from a static initializer, before the runtime has probed the CPU
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return { cullAvx2, "avx2" };
+        }
+        return { cullSse, "sse" };
+#elif SCENE_OBJECTS_NEON
+        return { cullNeon, "neon" };
+#else
+        return { cullScalar, "scalar" };
+#endif
+    }
+
+    const KernelChoice _kernel = selectKernel();
+
+    Soa _objects;
+    // slot -> id and id -> slot, so removal can swap the last object into the hole
+    std::vector<scene_objects::ObjectId> _slotIds;
+    std::vector<uint32_t> _idSlots;
+    std::vector<scene_objects::ObjectId> _freeIds;
+    // per task output, kept across frames
+    std::vector<std::vector<uint32_t>> _taskSlots;
+    std::vector<uint32_t> _visibleSlots;
+
+    // visible slots in storage order
+    size_t cullSlots(const Soa &soa, const Frustum &frustum, Kernel kernel, bool parallel, std::vector<uint32_t> &slots) {
+        size_t padded = soa.radius.size();
+        size_t taskCount = (padded + kCullGrain - 1) / kCullGrain;
+        if (_taskSlots.size() < taskCount) {
+            _taskSlots.resize(taskCount);
+        }
+        std::vector<size_t> taskVisible(taskCount, 0);
+        auto run = [&](size_t begin, size_t end) {
+            for (size_t task = begin; task < end; ++task) {
+                size_t first = task * kCullGrain;
+                size_t last = std::min(padded, first + kCullGrain);
+                std::vector<uint32_t> &out = _taskSlots[task];
+                if (out.size() < last - first) {
+                    out.resize(last - first);
+                }
+                taskVisible[task] = kernel(soa, first, last, frustum, out.data());
+            }
+        };
+        if (parallel) {
+            thread_pool::parallelFor(taskCount, 1, run);
+        } else {
+            run(0, taskCount);
+        }
+
+        size_t total = 0;
+        for (size_t task = 0; task < taskCount; ++task) {
+            total += taskVisible[task];
+        }
+        slots.resize(total);
+        uint32_t *out = slots.data();
+        for (size_t task = 0; task < taskCount; ++task) {
+            out = std::copy(_taskSlots[task].begin(), _taskSlots[task].begin() + taskVisible[task], out);
+        }
+        return total;
+    }
+
+    // column major perspective projection looking down -z, depth 0..1
+    void perspective(float fovY, float aspect, float nearPlane, float farPlane, float m[16]) {
+        float f = 1.0f / std::tan(fovY * 0.5f);
+        std::fill(m, m + 16, 0.0f);
+        m[0] = f / aspect;
+        m[5] = -f; // Vulkan's y points down
+        m[10] = farPlane / (nearPlane - farPlane);
+        m[11] = -1.0f;
+        m[14] = nearPlane * farPlane / (nearPlane - farPlane);
+    }
+}
+
+namespace scene_objects {
+    Bounds boundsFromBox(const float min[3], const float max[3]) {
+        Bounds bounds;
+        float radiusSquared = 0.0f;
+        for (int axis = 0; axis < 3; ++axis) {
+            bounds.min[axis] = min[axis];
+            bounds.max[axis] = max[axis];
+            bounds.center[axis] = (min[axis] + max[axis]) * 0.5f;
+            float half = (max[axis] - min[axis]) * 0.5f;
+            radiusSquared += half * half;
+        }
+        bounds.radius = std::sqrt(radiusSquared);
+        return bounds;
+    }
+
+    Frustum frustumFromMatrix(const float m[16]) {
+        // Gribb and Hartmann: planes are sums and differences of the matrix rows
+        float rows[4][4];
+        for (int row = 0; row < 4; ++row) {
+            for (int column = 0; column < 4; ++column) {
+                rows[row][column] = m[column * 4 + row];
+            }
+        }
+        Frustum frustum;
+        for (int c = 0; c < 4; ++c) {
+            frustum.planes[0][c] = rows[3][c] + rows[0][c]; // left
+            frustum.planes[1][c] = rows[3][c] - rows[0][c]; // right
+            frustum.planes[2][c] = rows[3][c] + rows[1][c]; // top (y down)
+            frustum.planes[3][c] = rows[3][c] - rows[1][c]; // bottom
+            frustum.planes[4][c] = rows[2][c];              // near, z >= 0
+            frustum.planes[5][c] = rows[3][c] - rows[2][c]; // far
+        }
+        for (auto &plane : frustum.planes) {
+            float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            if (length > 0.0f) {
+                for (float &value : plane) {
+                    value /= length;
+                }
+            }
+        }
+        return frustum;
+    }
+
+    ObjectId add(const Bounds &bounds) {
+        ObjectId id;
+        if (!_freeIds.empty()) {
+            id = _freeIds.back();
+            _freeIds.pop_back();
+        } else {
+            id = (ObjectId)_idSlots.size();
+            _idSlots.push_back(kNoSlot);
+        }
+        size_t slot = _objects.count;
+        _objects.resize(slot + 1);
+        _objects.set(slot, bounds);
+        _slotIds.push_back(id);
+        _idSlots[id] = (uint32_t)slot;
+        return id;
+    }
+
+    void update(ObjectId id, const Bounds &bounds) {
+        _objects.set(_idSlots[id], bounds);
+    }
+
+    void remove(ObjectId id) {
+        uint32_t slot = _idSlots[id];
+        uint32_t last = (uint32_t)_objects.count - 1;
+        if (slot != last) {
+            _objects.move(last, slot);
+            _slotIds[slot] = _slotIds[last];
+            _idSlots[_slotIds[slot]] = slot;
+        }
+        _slotIds.pop_back();
+        _objects.resize(last);
+        _idSlots[id] = kNoSlot;
+        _freeIds.push_back(id);
+    }
+
+    void clear() {
+        _objects = Soa();
+        _slotIds.clear();
+        _idSlots.clear();
+        _freeIds.clear();
+        _taskSlots.clear();
+        _visibleSlots.clear();
+    }
+
+    size_t count() {
+        return _objects.count;
+    }
+
+    void cull(const Frustum &frustum, std::vector<ObjectId> &visible) {
+        cullSlots(_objects, frustum, _kernel.kernel, true, _visibleSlots);
+        size_t first = visible.size();
+        visible.resize(first + _visibleSlots.size());
+        for (size_t i = 0; i < _visibleSlots.size(); ++i) {
+            visible[first + i] = _slotIds[_visibleSlots[i]];
+        }
+    }
+
+    const char *kernelName() {
+        return _kernel.name;
+    }
+
+    void benchmark(size_t objectCount) {
+        // objects spread around a camera at the origin; roughly a fifth end up visible
+        Soa soa;
+        soa.resize(objectCount);
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> size(0.1f, 5.0f);
+        for (size_t i = 0; i < objectCount; ++i) {
+            float center[3] = { position(random), position(random), position(random) };
+            float half = size(random);
+            float min[3] = { center[0] - half, center[1] - half, center[2] - half };
+            float max[3] = { center[0] + half, center[1] + half, center[2] + half };
+            soa.set(i, boundsFromBox(min, max));
+        }
+        float projection[16];
+        perspective(1.0f, 16.0f / 9.0f, 0.1f, 150.0f, projection);
+        Frustum frustum = frustumFromMatrix(projection);
+
+        struct Run {
+            const char *name;
+            Kernel kernel;
+            bool parallel;
+        };
+        const Run runs[] = {
+            { "scalar", cullScalar, false },
+            { _kernel.name, _kernel.kernel, false },
+            { _kernel.name, _kernel.kernel, true },
+        };
+        std::vector<uint32_t> slots;
+        for (const Run &run : runs) {
+            using Clock = std::chrono::steady_clock;
+            size_t iterations = 0;
+            size_t visible = 0;
+            Clock::time_point start = Clock::now();
+            double seconds = 0.0;
+            // at least a quarter second so timer resolution doesn't matter
+            do {
+                visible = cullSlots(soa, frustum, run.kernel, run.parallel, slots);
+                ++iterations;
+                seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            } while (seconds < 0.25);
+
+            std::cout << std::fixed << std::setprecision(1)
+                      << "[cull] " << run.name << (run.parallel ? " x" + std::to_string(thread_pool::concurrency()) + " threads" : ", 1 thread")
+                      << ": " << objectCount * iterations / seconds / 1e6 << " M objects/s, "
+                      << visible << " of " << objectCount << " visible" << std::endl;
+        }
+    }
+}
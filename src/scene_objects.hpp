@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounding volumes of everything drawable, kept as structure-of-arrays so they
+// can be frustum culled with SIMD across the thread pool. Owned by whichever
+// thread records draws; not synchronized.
+namespace scene_objects {
+    using ObjectId = uint32_t;
+
+    struct Bounds {
+        float center[3];
+        float radius;
+        float min[3];
+        float max[3];
+    };
+
+    // planes point inwards: a point is inside when dot(xyz, p) + w >= 0 for all six
+    struct Frustum {
+        float planes[6][4];
+    };
+
+    Bounds boundsFromBox(const float min[3], const float max[3]);
+    // column major, clip space depth from 0 to w as in Vulkan
+    Frustum frustumFromMatrix(const float viewProjection[16]);
+
+    // ids are never reused while the object is alive, and stay valid across removals of others
+    ObjectId add(const Bounds &bounds);
+    void update(ObjectId id, const Bounds &bounds);
+    void remove(ObjectId id);
+    void clear();
+    size_t count();
+
+    // appends the ids of objects whose sphere and box both intersect the frustum
+    void cull(const Frustum &frustum, std::vector<ObjectId> &visible);
+
+    // the kernel picked for this CPU: "avx2", "sse", "neon" or "scalar"
+    const char *kernelName();
+
+    // culls `objectCount` random objects with each kernel and logs objects per second
+    void benchmark(size_t objectCount);
+}
@@ -0,0 +1,59 @@
+#include "shader_module.hpp"
+
+#include <cassert>
+#include <fstream>
+
+#include "host_allocator.hpp"
+#include "vulkan_dispatch.hpp"
+
+namespace shader_module {
+    std::vector<char> bytesFromFile(const std::string &filename) {
+        std::ifstream file(filename, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            return std::vector<char>();
+        }
+        size_t fileSize = (size_t)file.tellg();
+        std::vector<char> buffer(fileSize);
+        file.seekg(0);
+        file.read(buffer.data(), fileSize);
+        file.close();
+        return buffer;
+    }
+
+    handles::ShaderModule fromFile(VkDevice device, const std::string &filename) {
+        std::vector<char> code = bytesFromFile(filename);
+
+        VkShaderModuleCreateInfo createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size();
+        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        VkShaderModule shaderModule;
+        VkResult result = dispatch::device.vkCreateShaderModule(device, &createInfo, host_allocator::callbacks(), &shaderModule);
+        assert(result == VK_SUCCESS);
+
+        return handles::ShaderModule(device, shaderModule);
+    }
+}
+
+namespace shader_module {
+    ShaderObjects::ShaderObjects(VkDevice device, const std::string &vertFileName, const std::string &fragFileName)
+        : _vertShaderModule(fromFile(device, vertFileName)),
+          _fragShaderModule(fromFile(device, fragFileName)) {
+    }
+
+    void ShaderObjects::specialize(VkShaderStageFlagBits stage, const SpecializationConstants &constants) {
+        assert(stage == VK_SHADER_STAGE_VERTEX_BIT || stage == VK_SHADER_STAGE_FRAGMENT_BIT);
+        (stage == VK_SHADER_STAGE_VERTEX_BIT ? _vertConstants : _fragConstants) = constants;
+    }
+
+    VkShaderModule ShaderObjects::module(VkShaderStageFlagBits stage) const {
+        assert(stage == VK_SHADER_STAGE_VERTEX_BIT || stage == VK_SHADER_STAGE_FRAGMENT_BIT);
+        return stage == VK_SHADER_STAGE_VERTEX_BIT ? _vertShaderModule.get() : _fragShaderModule.get();
+    }
+
+    const SpecializationConstants &ShaderObjects::constants(VkShaderStageFlagBits stage) const {
+        assert(stage == VK_SHADER_STAGE_VERTEX_BIT || stage == VK_SHADER_STAGE_FRAGMENT_BIT);
+        return stage == VK_SHADER_STAGE_VERTEX_BIT ? _vertConstants : _fragConstants;
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "specialization_constants.hpp"
+#include "vulkan_handles.hpp"
+
+namespace shader_module {
+    std::vector<char> bytesFromFile(const std::string &filename);
+    handles::ShaderModule fromFile(VkDevice device, const std::string &filename);
+
+    // a vertex and fragment shader pair plus the specialization each stage gets;
+    // pipeline_cache::PipelineKey::setShaders() turns it into pipeline state
+    class ShaderObjects {
+    public:
+        ShaderObjects(VkDevice device, const std::string &vertFileName, const std::string &fragFileName);
+        ShaderObjects(const ShaderObjects &) = delete;
+        ShaderObjects &operator=(const ShaderObjects &) = delete;
+
+        // applies to keys built from here on; pipelines already created keep their values
+        void specialize(VkShaderStageFlagBits stage, const SpecializationConstants &constants);
+
+        VkShaderModule module(VkShaderStageFlagBits stage) const;
+        const SpecializationConstants &constants(VkShaderStageFlagBits stage) const;
+
+    private:
+        handles::ShaderModule _vertShaderModule;
+        handles::ShaderModule _fragShaderModule;
+        SpecializationConstants _vertConstants;
+        SpecializationConstants _fragConstants;
+    };
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "include_vulkan.hpp"
+
+// Values for a shader's `layout(constant_id = N) const` declarations. They are
+// baked in at pipeline creation, so one SPIR-V module serves every variant and
+// the driver can fold the constants away.
+class SpecializationConstants {
+public:
+    // GLSL bools are 32 bits wide
+    SpecializationConstants &set(uint32_t constantId, bool value) { return store(constantId, (VkBool32)(value ? VK_TRUE : VK_FALSE)); }
+    SpecializationConstants &set(uint32_t constantId, int32_t value) { return store(constantId, value); }
+    SpecializationConstants &set(uint32_t constantId, uint32_t value) { return store(constantId, value); }
+    SpecializationConstants &set(uint32_t constantId, float value) { return store(constantId, value); }
+    SpecializationConstants &set(uint32_t constantId, double value) { return store(constantId, value); }
+
+    bool empty() const { return _entries.empty(); }
+
+    // same constants set in the same order
+    bool operator==(const SpecializationConstants &other) const {
+        if (_entries.size() != other._entries.size() || _data != other._data) {
+            return false;
+        }
+        for (size_t i = 0; i < _entries.size(); ++i) {
+            if (_entries[i].constantID != other._entries[i].constantID || _entries[i].size != other._entries[i].size) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // FNV-1a over ids, sizes and values
+    uint64_t hash() const {
+        uint64_t h = 0xcbf29ce484222325ull;
+        auto add = [&h](const void *bytes, size_t size) {
+            for (size_t i = 0; i < size; ++i) {
+                h = (h ^ static_cast<const uint8_t*>(bytes)[i]) * 0x100000001b3ull;
+            }
+        };
+        for (const VkSpecializationMapEntry &entry : _entries) {
+            uint32_t size = (uint32_t)entry.size;
+            add(&entry.constantID, sizeof(entry.constantID));
+            add(&size, sizeof(size));
+        }
+        add(_data.data(), _data.size());
+        return h;
+    }
+
+    // nullptr when there's nothing to specialize; points into this object, so it's
+    // valid until the next set() or until this object goes away
+    const VkSpecializationInfo *info() {
+        if (_entries.empty()) {
+            return nullptr;
+        }
+        _info.mapEntryCount = (uint32_t)_entries.size();
+        _info.pMapEntries = _entries.data();
+        _info.dataSize = _data.size();
+        _info.pData = _data.data();
+        return &_info;
+    }
+
+private:
+    template<typename T>
+    SpecializationConstants &store(uint32_t constantId, T value) {
+        for (const VkSpecializationMapEntry &entry : _entries) {
+            if (entry.constantID == constantId) {
+                // the shader declares one type per id
+                assert(entry.size == sizeof(T));
+                memcpy(&_data[entry.offset], &value, sizeof(T));
+                return *this;
+            }
+        }
+        VkSpecializationMapEntry entry = {};
+        entry.constantID = constantId;
+        entry.offset = (uint32_t)_data.size();
+        entry.size = sizeof(T);
+        _entries.push_back(entry);
+        _data.resize(_data.size() + sizeof(T));
+        memcpy(&_data[entry.offset], &value, sizeof(T));
+        return *this;
+    }
+
+    std::vector<VkSpecializationMapEntry> _entries;
+    std::vector<uint8_t> _data;
+    VkSpecializationInfo _info = {};
+};
@@ -0,0 +1,407 @@
+#include "sprite_batch.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "device_memory.hpp"
+#include "host_allocator.hpp"
+#include "pipeline_cache.hpp"
+#include "shader_module.hpp"
+#include "vulkan_dispatch.hpp"
+#include "vulkan_handles.hpp"
+
+namespace {
+    const uint32_t kMaxQuads = 65536;
+    // sprite.frag: 0 samples a texture, 1 a glyph atlas
+    const uint32_t kModeConstantId = 0;
+
+    enum class PipelineKind : uint8_t {
+        Color,
+        Texture,
+        Glyph,
+        Count
+    };
+
+    struct Vertex {
+        float position[2];
+        float texCoord[2];
+        uint32_t color;
+    };
+
+    struct Quad {
+        VkDescriptorSet texture;
+        PipelineKind kind;
+        Vertex vertices[4];
+    };
+
+    struct Draw {
+        PipelineKind kind;
+        VkDescriptorSet texture;
+        uint32_t firstQuad;
+        uint32_t quadCount;
+    };
+
+    struct FrameBuffer {
+        handles::Buffer buffer;
+        handles::DeviceMemory memory;
+        Vertex *mapped = nullptr;
+    };
+
+    VkDevice _device = VK_NULL_HANDLE;
+
+    handles::DescriptorSetLayout _descriptorSetLayout;
+    handles::PipelineLayout _pipelineLayout;
+    std::unique_ptr<shader_module::ShaderObjects> _colorShaders;
+    std::unique_ptr<shader_module::ShaderObjects> _texturedShaders;
+    // without a render pass; record() and prepare() fill in the one drawn into
+    pipeline_cache::PipelineKey _pipelineKeys[(size_t)PipelineKind::Count];
+
+    handles::Buffer _indexBuffer;
+    handles::DeviceMemory _indexMemory;
+    std::vector<FrameBuffer> _frameBuffers;
+
+    // per-frame state, reused to avoid reallocating every frame
+    uint32_t _frameSlot = 0;
+    bool _recording = false;
+    std::vector<Quad> _quads;
+    std::vector<std::pair<uint64_t, uint32_t>> _sortKeys;
+    std::vector<VkDescriptorSet> _textures;
+    std::vector<Draw> _draws;
+    bool _warnedOverflow = false;
+}
+
+namespace batching {
+    uint32_t textureId(VkDescriptorSet texture) {
+        // a handful of textures per frame; the last one is by far the most likely
+        if (!_textures.empty() && _textures.back() == texture) {
+            return (uint32_t)_textures.size() - 1;
+        }
+        for (uint32_t i = 0; i < _textures.size(); ++i) {
+            if (_textures[i] == texture) {
+                return i;
+            }
+        }
+        _textures.push_back(texture);
+        return (uint32_t)_textures.size() - 1;
+    }
+
+    Quad* push(PipelineKind kind, VkDescriptorSet texture, uint16_t layer) {
+        assert(_recording);
+        if (_quads.size() == kMaxQuads) {
+            if (!_warnedOverflow) {
+                std::cerr << "[sprite batch] more than " << kMaxQuads << " primitives in a frame; dropping the rest" << std::endl;
+                _warnedOverflow = true;
+            }
+            return nullptr;
+        }
+
+        uint64_t key = ((uint64_t)layer << 48) | ((uint64_t)kind << 40) | textureId(texture);
+        _sortKeys.emplace_back(key, (uint32_t)_quads.size());
+
+        _quads.emplace_back();
+        Quad *quad = &_quads.back();
+        quad->kind = kind;
+        quad->texture = texture;
+        return quad;
+    }
+
+    void setRect(Quad *quad, float x, float y, float width, float height,
+                 float u0, float v0, float u1, float v1, uint32_t color) {
+        quad->vertices[0] = { { x, y }, { u0, v0 }, color };
+        quad->vertices[1] = { { x + width, y }, { u1, v0 }, color };
+        quad->vertices[2] = { { x + width, y + height }, { u1, v1 }, color };
+        quad->vertices[3] = { { x, y + height }, { u0, v1 }, color };
+    }
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, handles::Buffer &buffer, handles::DeviceMemory &memory, void **mapped) {
+        {
+            VkBufferCreateInfo bufferInfo = {};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = size;
+            bufferInfo.usage = usage;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            VkBuffer handle;
+            VkResult result = dispatch::device.vkCreateBuffer(_device, &bufferInfo, host_allocator::callbacks(), &handle);
+            assert(result == VK_SUCCESS);
+            buffer = handles::Buffer(_device, handle);
+        }
+
+        VkMemoryRequirements requirements;
+        dispatch::device.vkGetBufferMemoryRequirements(_device, buffer.get(), &requirements);
+
+        // written by the CPU every frame and read once by the GPU; device local if the heap allows it
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = requirements.size;
+        allocInfo.memoryTypeIndex = device_memory::findMemoryType(requirements.memoryTypeBits,
+                                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        assert(allocInfo.memoryTypeIndex != std::numeric_limits<uint32_t>::max());
+
+        VkDeviceMemory handle;
+        VkResult result = device_memory::allocate(_device, allocInfo, device_memory::Category::Buffers, &handle);
+        assert(result == VK_SUCCESS);
+        memory = handles::DeviceMemory(_device, handle);
+
+        result = dispatch::device.vkBindBufferMemory(_device, buffer.get(), memory.get(), 0);
+        assert(result == VK_SUCCESS);
+
+        result = dispatch::device.vkMapMemory(_device, memory.get(), 0, VK_WHOLE_SIZE, 0, mapped);
+        assert(result == VK_SUCCESS);
+    }
+
+    void createPipelines() {
+        {
+            VkDescriptorSetLayoutBinding binding = {};
+            binding.binding = 0;
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            binding.descriptorCount = 1;
+            binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+            VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+            layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            layoutInfo.bindingCount = 1;
+            layoutInfo.pBindings = &binding;
+
+            VkDescriptorSetLayout descriptorSetLayout;
+            VkResult result = dispatch::device.vkCreateDescriptorSetLayout(_device, &layoutInfo, host_allocator::callbacks(), &descriptorSetLayout);
+            assert(result == VK_SUCCESS);
+            _descriptorSetLayout = handles::DescriptorSetLayout(_device, descriptorSetLayout);
+        }
+
+        {
+            VkPushConstantRange pushConstantRange = {};
+            pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+            pushConstantRange.offset = 0;
+            pushConstantRange.size = sizeof(float) * 4;
+
+            VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+            pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            pipelineLayoutInfo.setLayoutCount = 1;
+            pipelineLayoutInfo.pSetLayouts = _descriptorSetLayout.ptr();
+            pipelineLayoutInfo.pushConstantRangeCount = 1;
+            pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+            VkPipelineLayout pipelineLayout;
+            VkResult result = dispatch::device.vkCreatePipelineLayout(_device, &pipelineLayoutInfo, host_allocator::callbacks(), &pipelineLayout);
+            assert(result == VK_SUCCESS);
+            _pipelineLayout = handles::PipelineLayout(_device, pipelineLayout);
+        }
+
+        // flat color stays a separate shader so it has no sampler that would need a bound set;
+        // textured and glyph pipelines share one module and differ only in a specialization constant
+        _colorShaders = std::make_unique<shader_module::ShaderObjects>(_device, "sprite_vert.spv", "sprite_color_frag.spv");
+        _texturedShaders = std::make_unique<shader_module::ShaderObjects>(_device, "sprite_vert.spv", "sprite_frag.spv");
+
+        for (size_t kind = 0; kind < (size_t)PipelineKind::Count; ++kind) {
+            shader_module::ShaderObjects &shaders = kind == (size_t)PipelineKind::Color ? *_colorShaders : *_texturedShaders;
+            if (kind != (size_t)PipelineKind::Color) {
+                int32_t mode = kind == (size_t)PipelineKind::Glyph ? 1 : 0;
+                shaders.specialize(VK_SHADER_STAGE_FRAGMENT_BIT, SpecializationConstants().set(kModeConstantId, mode));
+            }
+
+            pipeline_cache::PipelineKey &key = _pipelineKeys[kind];
+            key = pipeline_cache::PipelineKey();
+            key.setShaders(shaders);
+            key.layout = _pipelineLayout.get();
+            key.vertexStride = sizeof(Vertex);
+            key.addAttribute(0, VK_FORMAT_R32G32_SFLOAT, (uint32_t)offsetof(Vertex, position));
+            key.addAttribute(1, VK_FORMAT_R32G32_SFLOAT, (uint32_t)offsetof(Vertex, texCoord));
+            key.addAttribute(2, VK_FORMAT_R8G8B8A8_UNORM, (uint32_t)offsetof(Vertex, color));
+            key.cullMode = VK_CULL_MODE_NONE; // lines may come out either winding
+            key.frontFace = VK_FRONT_FACE_CLOCKWISE;
+            key.setAlphaBlending();
+            key.subpass = 0;
+        }
+    }
+
+    pipeline_cache::PipelineKey keyFor(PipelineKind kind, VkRenderPass renderPass) {
+        pipeline_cache::PipelineKey key = _pipelineKeys[(size_t)kind];
+        key.renderPass = renderPass;
+        return key;
+    }
+}
+
+namespace sprite_batch {
+    void initialize(VkDevice device, uint32_t framesInFlight) {
+        _device = device;
+
+        batching::createPipelines();
+
+        { // every quad uses the same two triangles, so the index buffer never changes
+            void *mapped = nullptr;
+            batching::createBuffer(sizeof(uint32_t) * 6 * kMaxQuads, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, _indexBuffer, _indexMemory, &mapped);
+            uint32_t *indices = (uint32_t *)mapped;
+            for (uint32_t quad = 0; quad < kMaxQuads; ++quad) {
+                const uint32_t base = quad * 4;
+                *indices++ = base;
+                *indices++ = base + 1;
+                *indices++ = base + 2;
+                *indices++ = base + 2;
+                *indices++ = base + 3;
+                *indices++ = base;
+            }
+            dispatch::device.vkUnmapMemory(_device, _indexMemory.get());
+        }
+
+        _frameBuffers.resize(framesInFlight);
+        for (FrameBuffer &frame : _frameBuffers) {
+            void *mapped = nullptr;
+            batching::createBuffer(sizeof(Vertex) * 4 * kMaxQuads, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, frame.buffer, frame.memory, &mapped);
+            frame.mapped = (Vertex *)mapped;
+        }
+
+        _quads.reserve(1024);
+        _sortKeys.reserve(1024);
+    }
+
+    void prepare(VkRenderPass renderPass) {
+        for (size_t kind = 0; kind < (size_t)PipelineKind::Count; ++kind) {
+            pipeline_cache::get(batching::keyFor((PipelineKind)kind, renderPass));
+        }
+    }
+
+    void shutdown() {
+        for (FrameBuffer &frame : _frameBuffers) {
+            dispatch::device.vkUnmapMemory(_device, frame.memory.get());
+        }
+        _frameBuffers.clear();
+        _indexBuffer.reset();
+        _indexMemory.reset();
+        for (auto &key : _pipelineKeys) {
+            key = pipeline_cache::PipelineKey();
+        }
+        _colorShaders = nullptr;
+        _texturedShaders = nullptr;
+        _pipelineLayout.reset();
+        _descriptorSetLayout.reset();
+        _quads.clear();
+        _sortKeys.clear();
+        _textures.clear();
+        _draws.clear();
+        _device = VK_NULL_HANDLE;
+    }
+
+    VkDescriptorSetLayout descriptorSetLayout() {
+        return _descriptorSetLayout.get();
+    }
+
+    void begin(uint32_t frameSlot) {
+        assert(!_recording && frameSlot < _frameBuffers.size());
+        _recording = true;
+        _frameSlot = frameSlot;
+        _quads.clear();
+        _sortKeys.clear();
+        _textures.clear();
+        _draws.clear();
+    }
+
+    void quad(float x, float y, float width, float height, uint32_t color, uint16_t layer) {
+        if (Quad *quad = batching::push(PipelineKind::Color, VK_NULL_HANDLE, layer)) {
+            batching::setRect(quad, x, y, width, height, 0.0f, 0.0f, 0.0f, 0.0f, color);
+        }
+    }
+
+    void sprite(Texture texture, float x, float y, float width, float height,
+                float u0, float v0, float u1, float v1, uint32_t color, uint16_t layer) {
+        assert(texture != VK_NULL_HANDLE);
+        if (Quad *quad = batching::push(PipelineKind::Texture, texture, layer)) {
+            batching::setRect(quad, x, y, width, height, u0, v0, u1, v1, color);
+        }
+    }
+
+    void line(float x0, float y0, float x1, float y1, float thickness, uint32_t color, uint16_t layer) {
+        float dx = x1 - x0;
+        float dy = y1 - y0;
+        float length = std::sqrt(dx * dx + dy * dy);
+        if (length == 0.0f) {
+            return;
+        }
+        // offset both ends by half the thickness along the normal
+        float nx = -dy / length * thickness * 0.5f;
+        float ny = dx / length * thickness * 0.5f;
+
+        if (Quad *quad = batching::push(PipelineKind::Color, VK_NULL_HANDLE, layer)) {
+            quad->vertices[0] = { { x0 + nx, y0 + ny }, { 0.0f, 0.0f }, color };
+            quad->vertices[1] = { { x1 + nx, y1 + ny }, { 0.0f, 0.0f }, color };
+            quad->vertices[2] = { { x1 - nx, y1 - ny }, { 0.0f, 0.0f }, color };
+            quad->vertices[3] = { { x0 - nx, y0 - ny }, { 0.0f, 0.0f }, color };
+        }
+    }
+
+    void glyph(Texture atlas, float x, float y, float width, float height,
+               float u0, float v0, float u1, float v1, uint32_t color, uint16_t layer) {
+        assert(atlas != VK_NULL_HANDLE);
+        if (Quad *quad = batching::push(PipelineKind::Glyph, atlas, layer)) {
+            batching::setRect(quad, x, y, width, height, u0, v0, u1, v1, color);
+        }
+    }
+
+    void end() {
+        assert(_recording);
+        _recording = false;
+
+        // (key, submission index) pairs sort into a stable, deterministic order
+        std::sort(_sortKeys.begin(), _sortKeys.end());
+
+        Vertex *vertices = _frameBuffers[_frameSlot].mapped;
+        for (uint32_t i = 0; i < _sortKeys.size(); ++i) {
+            const Quad &quad = _quads[_sortKeys[i].second];
+            std::copy(quad.vertices, quad.vertices + 4, vertices + i * 4);
+
+            // adjacent quads sharing pipeline and texture collapse into one draw,
+            // even across layers, since the buffer already holds them in order
+            if (!_draws.empty() && _draws.back().kind == quad.kind && _draws.back().texture == quad.texture) {
+                _draws.back().quadCount++;
+            } else {
+                _draws.push_back({ quad.kind, quad.texture, i, 1 });
+            }
+        }
+    }
+
+    void record(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkExtent2D extent) {
+        assert(!_recording);
+        if (_draws.empty()) {
+            return;
+        }
+
+        VkDeviceSize offset = 0;
+        dispatch::device.vkCmdBindVertexBuffers(commandBuffer, 0, 1, _frameBuffers[_frameSlot].buffer.ptr(), &offset);
+        dispatch::device.vkCmdBindIndexBuffer(commandBuffer, _indexBuffer.get(), 0, VK_INDEX_TYPE_UINT32);
+
+        // pixels to normalized device coordinates
+        const float transform[4] = { 2.0f / extent.width, 2.0f / extent.height, -1.0f, -1.0f };
+        dispatch::device.vkCmdPushConstants(commandBuffer, _pipelineLayout.get(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(transform), transform);
+
+        VkViewport viewport = {};
+        viewport.width = (float)extent.width;
+        viewport.height = (float)extent.height;
+        viewport.maxDepth = 1.0f;
+        dispatch::device.vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor = {};
+        scissor.extent = extent;
+        dispatch::device.vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        PipelineKind boundKind = PipelineKind::Count;
+        VkDescriptorSet boundTexture = VK_NULL_HANDLE;
+        for (const Draw &draw : _draws) {
+            if (draw.kind != boundKind) {
+                dispatch::device.vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_cache::get(batching::keyFor(draw.kind, renderPass)));
+                boundKind = draw.kind;
+            }
+            if (draw.texture != VK_NULL_HANDLE && draw.texture != boundTexture) {
+                dispatch::device.vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout.get(), 0, 1, &draw.texture, 0, nullptr);
+                boundTexture = draw.texture;
+            }
+            dispatch::device.vkCmdDrawIndexed(commandBuffer, draw.quadCount * 6, 1, draw.firstQuad * 6, 0, 0);
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#include "include_vulkan.hpp"
+
+// Immediate-mode 2D batching for HUD and overlay geometry. Primitives are
+// queued between begin() and end(), sorted by layer, pipeline and texture,
+// written into a persistently mapped per-frame vertex buffer and drawn with
+// as few vkCmdDrawIndexed calls as possible. Coordinates are in pixels with
+// the origin at the top-left corner. Draw order is only guaranteed between
+// layers; primitives sharing a layer may be reordered to merge draws.
+namespace sprite_batch {
+    // textures are combined image sampler descriptor sets compatible with
+    // descriptorSetLayout(); glyph atlases are single channel coverage
+    using Texture = VkDescriptorSet;
+
+    inline uint32_t rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+        return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16) | ((uint32_t)a << 24);
+    }
+
+    void initialize(VkDevice device, uint32_t framesInFlight);
+    void shutdown();
+    // creates the pipelines for drawing into `renderPass` up front, so the
+    // first frame using it doesn't stall on them
+    void prepare(VkRenderPass renderPass);
+
+    VkDescriptorSetLayout descriptorSetLayout();
+
+    // `frameSlot` selects the vertex buffer; the previous use of the slot must have retired
+    void begin(uint32_t frameSlot);
+    void quad(float x, float y, float width, float height, uint32_t color, uint16_t layer = 0);
+    void sprite(Texture texture, float x, float y, float width, float height,
+                float u0, float v0, float u1, float v1, uint32_t color = 0xFFFFFFFF, uint16_t layer = 0);
+    void line(float x0, float y0, float x1, float y1, float thickness, uint32_t color, uint16_t layer = 0);
+    void glyph(Texture atlas, float x, float y, float width, float height,
+               float u0, float v0, float u1, float v1, uint32_t color, uint16_t layer = 0);
+    void end();
+
+    // must be called inside `renderPass`, drawing to images of `extent`
+    void record(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkExtent2D extent);
+}
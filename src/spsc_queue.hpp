@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+// Bounded single-producer/single-consumer queue. One thread may call push()
+// and one (other) thread may call pop(); neither ever blocks or takes a lock.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "elements are copied by value between threads");
+
+public:
+    bool push(const T &value) {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _cachedTail == Capacity) {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head - _cachedTail == Capacity) {
+                return false; // full
+            }
+        }
+        _slots[head & (Capacity - 1)] = value;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value) {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _cachedHead) {
+            _cachedHead = _head.load(std::memory_order_acquire);
+            if (tail == _cachedHead) {
+                return false; // empty
+            }
+        }
+        value = _slots[tail & (Capacity - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static const size_t kCacheLine = 64;
+
+    // producer side
+    alignas(kCacheLine) std::atomic<size_t> _head { 0 };
+    size_t _cachedTail = 0;
+
+    // consumer side
+    alignas(kCacheLine) std::atomic<size_t> _tail { 0 };
+    size_t _cachedHead = 0;
+
+    alignas(kCacheLine) T _slots[Capacity];
+};
@@ -0,0 +1,135 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+
+#include "profiler.hpp"
+
+namespace {
+    struct Job {
+        const std::function<void(size_t, size_t)> *body;
+        size_t count;
+        size_t rangeSize;
+        size_t rangeCount;
+        std::atomic<size_t> nextRange;
+        std::atomic<size_t> finishedRanges;
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::deque<std::shared_ptr<Job>> _jobs;
+    std::vector<std::thread> _workers;
+    bool _stopping = false;
+
+    // claims ranges until none are left; returns true if this call finished the job
+    bool runRanges(Job &job) {
+        bool finishedLast = false;
+        size_t range;
+        while ((range = job.nextRange.fetch_add(1)) < job.rangeCount) {
+            size_t begin = range * job.rangeSize;
+            size_t end = std::min(job.count, begin + job.rangeSize);
+            profiler::Scope scope("parallelFor range");
+            (*job.body)(begin, end);
+            if (job.finishedRanges.fetch_add(1) + 1 == job.rangeCount) {
+                finishedLast = true;
+            }
+        }
+        return finishedLast;
+    }
+
+    void workerLoop(unsigned index) {
+        profiler::setThreadName("worker " + std::to_string(index));
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (;;) {
+            _wake.wait(lock, [] { return _stopping || !_jobs.empty(); });
+            if (_jobs.empty()) {
+                return;
+            }
+            std::shared_ptr<Job> job = _jobs.front();
+            if (job->nextRange.load() >= job->rangeCount) {
+                // everything claimed; the owner takes it off the queue once it's done
+                _jobs.pop_front();
+                continue;
+            }
+            lock.unlock();
+            bool finishedLast = runRanges(*job);
+            lock.lock();
+            if (finishedLast) {
+                _wake.notify_all();
+            }
+        }
+    }
+}
+
+namespace thread_pool {
+    void start(unsigned workerCount) {
+        if (workerCount == 0) {
+            unsigned hardware = std::thread::hardware_concurrency();
+            workerCount = hardware > 1 ? hardware - 1 : 1;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = false;
+        for (unsigned i = 0; i < workerCount; ++i) {
+            _workers.emplace_back(workerLoop, i);
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        for (auto &worker : _workers) {
+            worker.join();
+        }
+        _workers.clear();
+    }
+
+    unsigned concurrency() {
+        return (unsigned)_workers.size() + 1;
+    }
+
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &body) {
+        if (count == 0) {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+        // a few ranges per thread so uneven ranges even out
+        size_t rangeSize = std::max(grain, (count + concurrency() * 4 - 1) / (concurrency() * 4));
+        size_t rangeCount = (count + rangeSize - 1) / rangeSize;
+        if (rangeCount == 1 || _workers.empty()) {
+            body(0, count);
+            return;
+        }
+
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->body = &body;
+        job->count = count;
+        job->rangeSize = rangeSize;
+        job->rangeCount = rangeCount;
+        job->nextRange = 0;
+        job->finishedRanges = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(job);
+        }
+        _wake.notify_all();
+
+        runRanges(*job);
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wake.wait(lock, [&job] { return job->finishedRanges.load() == job->rangeCount; });
+        auto queued = std::find(_jobs.begin(), _jobs.end(), job);
+        if (queued != _jobs.end()) {
+            _jobs.erase(queued);
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Fixed set of worker threads for data-parallel CPU work (asset import, culling).
+namespace thread_pool {
+    // 0 picks one worker per hardware thread, minus the calling thread
+    void start(unsigned workerCount = 0);
+    void stop();
+
+    // workers plus the calling thread
+    unsigned concurrency();
+
+    // splits [0, count) into ranges of at least `grain` items and runs them on the pool;
+    // the caller works too and returns once every range has finished. Safe to nest.
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &body);
+}
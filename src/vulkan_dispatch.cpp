@@ -0,0 +1,58 @@
+#include "vulkan_dispatch.hpp"
+
+#include <cassert>
+#include <iostream>
+
+namespace dispatch {
+    InstanceTable instance;
+    DeviceTable device;
+
+    void loadInstance(VkInstance vulkanInstance) {
+        assert(vulkanInstance != VK_NULL_HANDLE);
+        instance = {};
+
+#define DISPATCH_LOAD(name) \
+        instance.name = (PFN_##name)vkGetInstanceProcAddr(vulkanInstance, #name); \
+        if (instance.name == nullptr) { \
+            std::cerr << "[dispatch] missing instance function " #name << std::endl; \
+        } \
+        assert(instance.name != nullptr);
+        DISPATCH_INSTANCE_FUNCTIONS(DISPATCH_LOAD)
+#undef DISPATCH_LOAD
+
+#define DISPATCH_LOAD_OPTIONAL(name) \
+        instance.name = (PFN_##name)vkGetInstanceProcAddr(vulkanInstance, #name);
+        DISPATCH_OPTIONAL_INSTANCE_FUNCTIONS(DISPATCH_LOAD_OPTIONAL)
+#undef DISPATCH_LOAD_OPTIONAL
+    }
+
+    void loadDevice(VkDevice vulkanDevice) {
+        assert(vulkanDevice != VK_NULL_HANDLE);
+        assert(instance.vkGetDeviceProcAddr != nullptr);
+        device = {};
+
+        // vkGetDeviceProcAddr hands out the driver's own entry points, skipping
+        // the loader's per-call lookup of the device's dispatch table
+#define DISPATCH_LOAD(name) \
+        device.name = (PFN_##name)instance.vkGetDeviceProcAddr(vulkanDevice, #name); \
+        if (device.name == nullptr) { \
+            std::cerr << "[dispatch] missing device function " #name << std::endl; \
+        } \
+        assert(device.name != nullptr);
+        DISPATCH_DEVICE_FUNCTIONS(DISPATCH_LOAD)
+#undef DISPATCH_LOAD
+
+#define DISPATCH_LOAD_OPTIONAL(name) \
+        device.name = (PFN_##name)instance.vkGetDeviceProcAddr(vulkanDevice, #name);
+        DISPATCH_OPTIONAL_DEVICE_FUNCTIONS(DISPATCH_LOAD_OPTIONAL)
+#undef DISPATCH_LOAD_OPTIONAL
+    }
+
+    void unloadDevice() {
+        device = {};
+    }
+
+    void unloadInstance() {
+        instance = {};
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "include_vulkan.hpp"
+
+// Entry points resolved with vkGetInstanceProcAddr/vkGetDeviceProcAddr, so
+// calls go straight to the driver instead of through the loader's exported
+// trampolines. Call through dispatch::instance / dispatch::device, e.g.
+// dispatch::device.vkCmdDraw(...); global functions (vkCreateInstance and the
+// vkEnumerateInstance* queries) still go through the loader.
+//
+// To call a new function, add it to the matching list below. Functions in the
+// optional lists come from extensions that may not be enabled and are left
+// null when the driver doesn't provide them.
+
+#define DISPATCH_INSTANCE_FUNCTIONS(X) \
+    X(vkDestroyInstance) \
+    X(vkEnumeratePhysicalDevices) \
+    X(vkGetPhysicalDeviceProperties) \
+    X(vkGetPhysicalDeviceFeatures) \
+    X(vkGetPhysicalDeviceMemoryProperties) \
+    X(vkGetPhysicalDeviceQueueFamilyProperties) \
+    X(vkEnumerateDeviceExtensionProperties) \
+    X(vkCreateDevice) \
+    X(vkGetDeviceProcAddr) \
+    X(vkDestroySurfaceKHR) \
+    X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+    X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+    X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+    X(vkGetPhysicalDeviceSurfacePresentModesKHR)
+
+#define DISPATCH_OPTIONAL_INSTANCE_FUNCTIONS(X) \
+    X(vkCreateDebugUtilsMessengerEXT) \
+    X(vkDestroyDebugUtilsMessengerEXT) \
+    X(vkGetPhysicalDeviceMemoryProperties2KHR) \
+    X(vkCreateHeadlessSurfaceEXT)
+
+#define DISPATCH_DEVICE_FUNCTIONS(X) \
+    X(vkDestroyDevice) \
+    X(vkDeviceWaitIdle) \
+    X(vkGetDeviceQueue) \
+    X(vkQueueSubmit) \
+    X(vkAllocateMemory) \
+    X(vkFreeMemory) \
+    X(vkMapMemory) \
+    X(vkUnmapMemory) \
+    X(vkInvalidateMappedMemoryRanges) \
+    X(vkCreateBuffer) \
+    X(vkDestroyBuffer) \
+    X(vkGetBufferMemoryRequirements) \
+    X(vkBindBufferMemory) \
+    X(vkCreateImageView) \
+    X(vkDestroyImageView) \
+    X(vkCreateShaderModule) \
+    X(vkDestroyShaderModule) \
+    X(vkCreatePipelineCache) \
+    X(vkDestroyPipelineCache) \
+    X(vkCreateGraphicsPipelines) \
+    X(vkDestroyPipeline) \
+    X(vkCreatePipelineLayout) \
+    X(vkDestroyPipelineLayout) \
+    X(vkCreateDescriptorSetLayout) \
+    X(vkDestroyDescriptorSetLayout) \
+    X(vkCreateRenderPass) \
+    X(vkDestroyRenderPass) \
+    X(vkCreateFramebuffer) \
+    X(vkDestroyFramebuffer) \
+    X(vkCreateCommandPool) \
+    X(vkDestroyCommandPool) \
+    X(vkAllocateCommandBuffers) \
+    X(vkBeginCommandBuffer) \
+    X(vkEndCommandBuffer) \
+    X(vkCreateFence) \
+    X(vkDestroyFence) \
+    X(vkWaitForFences) \
+    X(vkResetFences) \
+    X(vkCreateSemaphore) \
+    X(vkDestroySemaphore) \
+    X(vkCreateQueryPool) \
+    X(vkDestroyQueryPool) \
+    X(vkGetQueryPoolResults) \
+    X(vkCmdBeginRenderPass) \
+    X(vkCmdEndRenderPass) \
+    X(vkCmdBindPipeline) \
+    X(vkCmdBindDescriptorSets) \
+    X(vkCmdBindVertexBuffers) \
+    X(vkCmdBindIndexBuffer) \
+    X(vkCmdSetViewport) \
+    X(vkCmdSetScissor) \
+    X(vkCmdPushConstants) \
+    X(vkCmdDraw) \
+    X(vkCmdDrawIndexed) \
+    X(vkCmdPipelineBarrier) \
+    X(vkCmdCopyImageToBuffer) \
+    X(vkCmdResetQueryPool) \
+    X(vkCmdBeginQuery) \
+    X(vkCmdEndQuery) \
+    X(vkCmdWriteTimestamp) \
+    X(vkCmdCopyQueryPoolResults) \
+    X(vkCreateSwapchainKHR) \
+    X(vkDestroySwapchainKHR) \
+    X(vkGetSwapchainImagesKHR) \
+    X(vkAcquireNextImageKHR) \
+    X(vkQueuePresentKHR)
+
+#define DISPATCH_OPTIONAL_DEVICE_FUNCTIONS(X) \
+    X(vkCmdBeginConditionalRenderingEXT) \
+    X(vkCmdEndConditionalRenderingEXT)
+
+namespace dispatch {
+#define DISPATCH_DECLARE(name) PFN_##name name = nullptr;
+    struct InstanceTable {
+        DISPATCH_INSTANCE_FUNCTIONS(DISPATCH_DECLARE)
+        DISPATCH_OPTIONAL_INSTANCE_FUNCTIONS(DISPATCH_DECLARE)
+    };
+
+    struct DeviceTable {
+        DISPATCH_DEVICE_FUNCTIONS(DISPATCH_DECLARE)
+        DISPATCH_OPTIONAL_DEVICE_FUNCTIONS(DISPATCH_DECLARE)
+    };
+#undef DISPATCH_DECLARE
+
+    extern InstanceTable instance;
+    extern DeviceTable device;
+
+    // right after vkCreateInstance; replaces whatever an earlier instance loaded
+    void loadInstance(VkInstance vulkanInstance);
+    // right after vkCreateDevice, once loadInstance() has run
+    void loadDevice(VkDevice vulkanDevice);
+    // after vkDestroyDevice / vkDestroyInstance, so nothing calls into a dead object
+    void unloadDevice();
+    void unloadInstance();
+}
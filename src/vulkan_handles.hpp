@@ -0,0 +1,101 @@
+#pragma once
+
+#include "deletion_queue.hpp"
+#include "device_memory.hpp"
+#include "host_allocator.hpp"
+#include "include_vulkan.hpp"
+#include "vulkan_dispatch.hpp"
+
+namespace handles {
+    // Move-only owner of a device-level Vulkan object. Releasing it hands the
+    // object to the deletion queue instead of destroying it on the spot.
+    template <typename T, void (*Destroy)(VkDevice, T)>
+    class Unique {
+    public:
+        Unique() = default;
+        Unique(VkDevice device, T handle) : _device(device), _handle(handle) {}
+
+        ~Unique() {
+            reset();
+        }
+
+        Unique(const Unique &) = delete;
+        Unique& operator=(const Unique &) = delete;
+
+        Unique(Unique &&other) : _device(other._device), _handle(other.release()) {}
+
+        Unique& operator=(Unique &&other) {
+            if (this != &other) {
+                reset();
+                _device = other._device;
+                _handle = other.release();
+            }
+            return *this;
+        }
+
+        T get() const {
+            return _handle;
+        }
+
+        const T* ptr() const {
+            return &_handle;
+        }
+
+        explicit operator bool() const {
+            return _handle != VK_NULL_HANDLE;
+        }
+
+        T release() {
+            T handle = _handle;
+            _handle = VK_NULL_HANDLE;
+            return handle;
+        }
+
+        void reset() {
+            if (_handle == VK_NULL_HANDLE) {
+                return;
+            }
+            VkDevice device = _device;
+            T handle = release();
+            deletion_queue::defer([device, handle]() { Destroy(device, handle); });
+        }
+
+    private:
+        VkDevice _device = VK_NULL_HANDLE;
+        T _handle = VK_NULL_HANDLE;
+    };
+
+    namespace destroy {
+        inline void swapchain(VkDevice device, VkSwapchainKHR handle) { dispatch::device.vkDestroySwapchainKHR(device, handle, host_allocator::callbacks()); }
+        inline void imageView(VkDevice device, VkImageView handle) { dispatch::device.vkDestroyImageView(device, handle, host_allocator::callbacks()); }
+        inline void shaderModule(VkDevice device, VkShaderModule handle) { dispatch::device.vkDestroyShaderModule(device, handle, host_allocator::callbacks()); }
+        inline void renderPass(VkDevice device, VkRenderPass handle) { dispatch::device.vkDestroyRenderPass(device, handle, host_allocator::callbacks()); }
+        inline void pipelineLayout(VkDevice device, VkPipelineLayout handle) { dispatch::device.vkDestroyPipelineLayout(device, handle, host_allocator::callbacks()); }
+        inline void pipeline(VkDevice device, VkPipeline handle) { dispatch::device.vkDestroyPipeline(device, handle, host_allocator::callbacks()); }
+        inline void pipelineCache(VkDevice device, VkPipelineCache handle) { dispatch::device.vkDestroyPipelineCache(device, handle, host_allocator::callbacks()); }
+        inline void queryPool(VkDevice device, VkQueryPool handle) { dispatch::device.vkDestroyQueryPool(device, handle, host_allocator::callbacks()); }
+        inline void framebuffer(VkDevice device, VkFramebuffer handle) { dispatch::device.vkDestroyFramebuffer(device, handle, host_allocator::callbacks()); }
+        inline void commandPool(VkDevice device, VkCommandPool handle) { dispatch::device.vkDestroyCommandPool(device, handle, host_allocator::callbacks()); }
+        inline void semaphore(VkDevice device, VkSemaphore handle) { dispatch::device.vkDestroySemaphore(device, handle, host_allocator::callbacks()); }
+        inline void fence(VkDevice device, VkFence handle) { dispatch::device.vkDestroyFence(device, handle, host_allocator::callbacks()); }
+        inline void buffer(VkDevice device, VkBuffer handle) { dispatch::device.vkDestroyBuffer(device, handle, host_allocator::callbacks()); }
+        inline void descriptorSetLayout(VkDevice device, VkDescriptorSetLayout handle) { dispatch::device.vkDestroyDescriptorSetLayout(device, handle, host_allocator::callbacks()); }
+        inline void deviceMemory(VkDevice device, VkDeviceMemory handle) { device_memory::free(device, handle); }
+    }
+
+    using Swapchain = Unique<VkSwapchainKHR, destroy::swapchain>;
+    using ImageView = Unique<VkImageView, destroy::imageView>;
+    using ShaderModule = Unique<VkShaderModule, destroy::shaderModule>;
+    using RenderPass = Unique<VkRenderPass, destroy::renderPass>;
+    using PipelineLayout = Unique<VkPipelineLayout, destroy::pipelineLayout>;
+    using Pipeline = Unique<VkPipeline, destroy::pipeline>;
+    using PipelineCache = Unique<VkPipelineCache, destroy::pipelineCache>;
+    using QueryPool = Unique<VkQueryPool, destroy::queryPool>;
+    using Framebuffer = Unique<VkFramebuffer, destroy::framebuffer>;
+    using CommandPool = Unique<VkCommandPool, destroy::commandPool>;
+    using Semaphore = Unique<VkSemaphore, destroy::semaphore>;
+    using Fence = Unique<VkFence, destroy::fence>;
+    using Buffer = Unique<VkBuffer, destroy::buffer>;
+    using DescriptorSetLayout = Unique<VkDescriptorSetLayout, destroy::descriptorSetLayout>;
+    using DeviceMemory = Unique<VkDeviceMemory, destroy::deviceMemory>;
+}
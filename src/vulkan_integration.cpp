@@ -1,70 +1,95 @@
 #include "vulkan_integration.hpp"
 
+#include <algorithm>
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
 #include <vector>
 
+#include "deletion_queue.hpp"
+#include "device_memory.hpp"
+#include "frame_capture.hpp"
+#include "frame_stats.hpp"
 #include "glfw_integration.hpp"
+#include "gpu_queries.hpp"
+#include "host_allocator.hpp"
 #include "include_vulkan.hpp"
-
-#ifndef VK_ICD_FILENAMES
-    #error Must define VK_ICD_FILENAMES at build time
-#endif
-
-#ifndef VK_LAYER_PATH
-    #error Must define VK_LAYER_PATH at build time
-#endif
+#include "pipeline_cache.hpp"
+#include "profiler.hpp"
+#include "scene_objects.hpp"
+#include "shader_module.hpp"
+#include "sprite_batch.hpp"
+#include "vulkan_dispatch.hpp"
+#include "vulkan_handles.hpp"
 
 namespace {
+    vulkan::Settings _settings;
     VkInstance _instance = VK_NULL_HANDLE;
+    std::vector<const char *> _enabledLayers;
+    std::vector<const char *> _enabledExtensions;
     VkDebugUtilsMessengerEXT _debugMessenger = VK_NULL_HANDLE;
-    VkSurfaceKHR _surface = VK_NULL_HANDLE;
     VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
     uint32_t _queueFamilyIndex = std::numeric_limits<uint32_t>::max();
     VkDevice _device = VK_NULL_HANDLE;
+    std::vector<const char *> _enabledDeviceExtensions;
     VkQueue _graphicsQueue = VK_NULL_HANDLE;
-    VkSwapchainKHR _swapChain = VK_NULL_HANDLE;
-    std::vector<VkImageView> _swapChainImageViews;
-    VkSurfaceFormatKHR _swapChainImageFormat;
-    VkExtent2D _swapChainExtent;
-    std::vector<VkFramebuffer> _swapChainFramebuffers;
+    VkPhysicalDeviceFeatures _enabledDeviceFeatures = {};
+    // size of the primary window's images when capture started
+    VkExtent2D _captureExtent = {};
+
+    // one per window; the first is the primary output, the one that carries
+    // the GPU queries and gets captured
+    struct Output {
+        VkSurfaceKHR surface = VK_NULL_HANDLE;
+        handles::Swapchain swapChain;
+        std::vector<VkImage> images;
+        std::vector<handles::ImageView> imageViews;
+        VkSurfaceFormatKHR format = {};
+        VkExtent2D extent = {};
+        // shared by the outputs with the same format, owned by the scene
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        std::vector<handles::Framebuffer> framebuffers;
+        // per frame in flight, signaled when the acquired image is ready
+        std::vector<handles::Semaphore> imageAvailableSemaphores;
+        // fence of the frame last rendering to each image
+        std::vector<VkFence> imagesInFlight;
+        // whether this frame got an image; an output that didn't sits the frame out
+        bool acquired = false;
+        // out of date or suboptimal, rebuilt after the frame is presented
+        bool stale = false;
+        VkResult lastAcquireResult = VK_SUCCESS;
+        VkResult lastPresentResult = VK_SUCCESS;
+    };
+    std::vector<Output> _outputs;
+
+    // one per output per frame in flight, indexed [slot * outputs + output]
     std::vector<VkCommandBuffer> _commandBuffers;
 }
 
 namespace utility {
-    std::vector<char> bytesFromFile(const std::string &filename) {
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-        if (!file.is_open()) {
-            return std::vector<char>();
+    bool containsExtension(const std::vector<const char *> &extensions, const char *name) {
+        for (auto extension : extensions) {
+            if (strcmp(extension, name) == 0) {
+                return true;
+            }
         }
-        size_t fileSize = (size_t)file.tellg();
-        std::vector<char> buffer(fileSize);
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
-        file.close();
-        return buffer;
+        return false;
     }
 
-    VkShaderModule shaderModuleFromFile(const std::string &filename) {
-        std::vector<char> code = bytesFromFile(filename);
-
-        VkShaderModuleCreateInfo createInfo = {};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-        VkShaderModule shaderModule;
-        VkResult result = vkCreateShaderModule(_device, &createInfo, nullptr, &shaderModule);
-        assert(result == VK_SUCCESS);
-
-        return shaderModule;
+    // one window failing doesn't stop the others; report changes only
+    void reportResult(const char *operation, size_t output, VkResult result, VkResult &lastResult) {
+        if (result != lastResult) {
+            if (result != VK_SUCCESS) {
+                std::cerr << "[" << operation << "] window " << output << " result: " << result << std::endl;
+            }
+            lastResult = result;
+        }
     }
 }
 
 namespace debug_utils {
     VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
-        static auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+        // resolved per instance by dispatch::loadInstance(), null without VK_EXT_debug_utils
+        auto func = dispatch::instance.vkCreateDebugUtilsMessengerEXT;
         if (func != nullptr) {
             return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
         } else {
@@ -73,7 +98,7 @@ namespace debug_utils {
     }
 
     void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator) {
-        static auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+        auto func = dispatch::instance.vkDestroyDebugUtilsMessengerEXT;
         if (func != nullptr) {
             func(instance, debugMessenger, pAllocator);
         }
@@ -89,7 +114,8 @@ namespace debug_utils {
 }
 
 namespace config {
-    std::vector<const char *> requiredLayers() {
+    // enabled when installed; a bare driver install (e.g. lavapipe in CI) has none
+    std::vector<const char *> optionalLayers() {
         return { "VK_LAYER_KHRONOS_validation" };
     }
 
@@ -97,8 +123,17 @@ namespace config {
         return { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
     };
 
+    std::vector<const char*> optionalDeviceExtensions() {
+        return { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME };
+    };
+
+    std::vector<const char *> optionalExtensions() {
+        // properties2 is needed to query VK_EXT_memory_budget
+        return { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, VK_EXT_DEBUG_UTILS_EXTENSION_NAME };
+    }
+
     std::vector<const char *> requiredExtensions() {
-        std::vector <const char *> allExtensions = { VK_EXT_DEBUG_UTILS_EXTENSION_NAME };
+        std::vector <const char *> allExtensions;
         std::vector<const char *> glfwExtensions = glfw::requiredVulkanExtensions();
         for (auto candidate : glfwExtensions) {
             for (auto ptr : allExtensions) {
@@ -117,18 +152,19 @@ namespace config {
         return VK_FORMAT_B8G8R8A8_UNORM;
     }
 
-    VkPresentModeKHR preferredPresentMode() {
-        #if 1 // v-sync ON?
-            return VK_PRESENT_MODE_FIFO_KHR;
-        #else
-            return VK_PRESENT_MODE_IMMEDIATE_KHR;
-        #endif
+    // most preferred first; FIFO is always supported, so the list ends with it
+    std::vector<VkPresentModeKHR> presentModes() {
+        if (_settings.vsync) {
+            return { VK_PRESENT_MODE_FIFO_KHR };
+        }
+        return { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR };
     }
 }
 
 namespace steps {
     void createInstance() {
-        std::vector<const char *> requiredLayers = config::requiredLayers();
+        profiler::Scope scope("createInstance");
+        std::vector<const char *> enabledLayers;
         std::vector<const char *> requiredExtensions = config::requiredExtensions();
 
         { // list available layers
@@ -145,7 +181,7 @@ namespace steps {
             }
             std::cout << std::endl;
 
-            for (auto layerName : requiredLayers) {
+            for (auto layerName : config::optionalLayers()) {
                 bool found = false;
                 for (int i = 0; i < layerCount; ++i) {
                     if (strcmp(layerName, layers[i].layerName) == 0) {
@@ -153,7 +189,11 @@ namespace steps {
                         break;
                     }
                 }
-                assert(found);
+                if (found) {
+                    enabledLayers.push_back(layerName);
+                } else {
+                    std::cerr << "[vulkan] layer " << layerName << " not available, running without it" << std::endl;
+                }
             }
         }
 
@@ -181,20 +221,36 @@ namespace steps {
                 }
                 assert(found);
             }
+
+            for (auto extensionName : config::optionalExtensions()) {
+                for (int i = 0; i < extensionCount; ++i) {
+                    if (strcmp(extensionName, extensions[i].extensionName) == 0) {
+                        requiredExtensions.push_back(extensionName);
+                        break;
+                    }
+                }
+            }
         }
 
         VkInstanceCreateInfo info = {};
-        info.enabledLayerCount = requiredLayers.size();
-        info.ppEnabledLayerNames = requiredLayers.data();
+        info.enabledLayerCount = enabledLayers.size();
+        info.ppEnabledLayerNames = enabledLayers.data();
         info.enabledExtensionCount = requiredExtensions.size();
         info.ppEnabledExtensionNames = requiredExtensions.data();
 
-        VkResult result = vkCreateInstance(&info, NULL, &_instance);
+        VkResult result = vkCreateInstance(&info, host_allocator::callbacks(), &_instance);
         std::cout << "vkCreateInstance result: " << result << std::endl;
+        _enabledLayers = enabledLayers;
+        _enabledExtensions = requiredExtensions;
+        dispatch::loadInstance(_instance);
         std::cout << std::endl;
     }
 
     void setupDebugCallback() {
+        profiler::Scope scope("setupDebugCallback");
+        if (!utility::containsExtension(_enabledExtensions, VK_EXT_DEBUG_UTILS_EXTENSION_NAME)) {
+            return;
+        }
         VkDebugUtilsMessengerCreateInfoEXT createInfo {
             VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
             {},
@@ -205,38 +261,54 @@ namespace steps {
             nullptr,
         };
 
-        VkResult result = debug_utils::CreateDebugUtilsMessengerEXT(_instance, &createInfo, nullptr, &_debugMessenger);
+        VkResult result = debug_utils::CreateDebugUtilsMessengerEXT(_instance, &createInfo, host_allocator::callbacks(), &_debugMessenger);
         assert(result == VK_SUCCESS);
     }
 
-    void setupSurface() {
-        _surface = (VkSurfaceKHR)glfw::createSurface(_instance);
+    void setupSurfaces() {
+        profiler::Scope scope("setupSurfaces");
+        _outputs.resize(glfw::windowCount());
+        for (uint32_t i = 0; i < _outputs.size(); ++i) {
+            if (glfw::headless()) {
+                // presented images go nowhere, but can still be captured
+                VkHeadlessSurfaceCreateInfoEXT createInfo = {};
+                createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+                assert(dispatch::instance.vkCreateHeadlessSurfaceEXT != nullptr);
+                VkResult result = dispatch::instance.vkCreateHeadlessSurfaceEXT(_instance, &createInfo, host_allocator::callbacks(), &_outputs[i].surface);
+                assert(result == VK_SUCCESS);
+            } else {
+                _outputs[i].surface = (VkSurfaceKHR)glfw::createSurface(_instance, i);
+            }
+        }
     }
 
     void setupDevice() {
+        profiler::Scope scope("setupDevice");
         std::vector<const char *> requiredDeviceExtensions = config::requiredDeviceExtensions();
 
         { // list physical devices
             auto integratedGPU = std::make_pair<VkPhysicalDevice, uint32_t>(VK_NULL_HANDLE, 0);
             auto discreteGPU = std::make_pair<VkPhysicalDevice, uint32_t>(VK_NULL_HANDLE, 0);
+            // virtual GPUs and software rasterizers (lavapipe, SwiftShader), for machines without a GPU
+            auto fallbackDevice = std::make_pair<VkPhysicalDevice, uint32_t>(VK_NULL_HANDLE, 0);
 
             uint32_t deviceCount = 0;
-            vkEnumeratePhysicalDevices(_instance, &deviceCount, nullptr);
+            dispatch::instance.vkEnumeratePhysicalDevices(_instance, &deviceCount, nullptr);
             std::cout << deviceCount << " devices found:\n";
             if (deviceCount > 0) {
                 auto devices = std::make_unique<VkPhysicalDevice[]>(deviceCount);
-                vkEnumeratePhysicalDevices(_instance, &deviceCount, devices.get());
+                dispatch::instance.vkEnumeratePhysicalDevices(_instance, &deviceCount, devices.get());
                 for (int i = 0; i < deviceCount; ++i) {
                     VkPhysicalDeviceProperties deviceProperties;
-                    vkGetPhysicalDeviceProperties(devices[i], &deviceProperties);
+                    dispatch::instance.vkGetPhysicalDeviceProperties(devices[i], &deviceProperties);
                     std::cout << "-> "<< deviceProperties.deviceName << ", type " << deviceProperties.deviceType << std::endl;
 
                     bool supportsAllExtensions = true;
                     { // list device supported extensions
                         uint32_t extensionCount;
-                        vkEnumerateDeviceExtensionProperties(devices[i], nullptr, &extensionCount, nullptr);
+                        dispatch::instance.vkEnumerateDeviceExtensionProperties(devices[i], nullptr, &extensionCount, nullptr);
                         auto availableExtensions = std::make_unique<VkExtensionProperties[]>(extensionCount);
-                        vkEnumerateDeviceExtensionProperties(devices[i], nullptr, &extensionCount, availableExtensions.get());
+                        dispatch::instance.vkEnumerateDeviceExtensionProperties(devices[i], nullptr, &extensionCount, availableExtensions.get());
 
                         for (auto ext : requiredDeviceExtensions) {
                             bool found = false;
@@ -256,19 +328,24 @@ namespace steps {
                     uint32_t suitableQueueIndex = std::numeric_limits<uint32_t>::max();
                     { // list device queues and check we can use the device
                         uint32_t queueFamilyCount = 0;
-                        vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queueFamilyCount, nullptr);
+                        dispatch::instance.vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queueFamilyCount, nullptr);
                         // std::cout << queueFamilyCount << " queue families found:\n";
                         if (queueFamilyCount > 0) {
                             auto queueFamilies = std::make_unique<VkQueueFamilyProperties[]>(queueFamilyCount);
-                            vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queueFamilyCount, queueFamilies.get());
-                            for (int i = 0; i < queueFamilyCount; ++i) {
-                                // std::cout << "-> "<< queueFamilies[i].queueCount << ", " << queueFamilies[i].queueFlags << std::endl;
-                                VkBool32 presentSupport = false;
-                                vkGetPhysicalDeviceSurfaceSupportKHR(devices[i], i, _surface, &presentSupport);
-                                if (queueFamilies[i].queueCount > 0 &&
-                                    (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+                            dispatch::instance.vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queueFamilyCount, queueFamilies.get());
+                            for (uint32_t family = 0; family < queueFamilyCount; ++family) {
+                                // std::cout << "-> "<< queueFamilies[family].queueCount << ", " << queueFamilies[family].queueFlags << std::endl;
+                                // one queue presents every window, so it must reach all of their surfaces
+                                VkBool32 presentSupport = !_outputs.empty();
+                                for (const Output &output : _outputs) {
+                                    VkBool32 surfaceSupport = false;
+                                    dispatch::instance.vkGetPhysicalDeviceSurfaceSupportKHR(devices[i], family, output.surface, &surfaceSupport);
+                                    presentSupport = presentSupport && surfaceSupport;
+                                }
+                                if (queueFamilies[family].queueCount > 0 &&
+                                    (queueFamilies[family].queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
                                     presentSupport) {
-                                    suitableQueueIndex = i;
+                                    suitableQueueIndex = family;
                                     break;
                                 }
                             }
@@ -280,6 +357,8 @@ namespace steps {
                             integratedGPU = std::make_pair(devices[i], suitableQueueIndex);
                         } else if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
                             discreteGPU = std::make_pair(devices[i], suitableQueueIndex);
+                        } else if (fallbackDevice.first == VK_NULL_HANDLE) {
+                            fallbackDevice = std::make_pair(devices[i], suitableQueueIndex);
                         }
                     }
                 }
@@ -291,17 +370,41 @@ namespace steps {
             } else if (integratedGPU.first != VK_NULL_HANDLE) {
                 _physicalDevice = integratedGPU.first;
                 _queueFamilyIndex = integratedGPU.second;
+            } else if (fallbackDevice.first != VK_NULL_HANDLE) {
+                _physicalDevice = fallbackDevice.first;
+                _queueFamilyIndex = fallbackDevice.second;
             } else {
                 assert(0); // can't find a suitable device
             }
 
             VkPhysicalDeviceProperties deviceProperties;
-            vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
+            dispatch::instance.vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
             std::cout << "Using "<< deviceProperties.deviceName << std::endl;
 
             std::cout << std::endl;
         }
 
+        { // enable whichever optional extensions the chosen device supports
+            uint32_t extensionCount;
+            dispatch::instance.vkEnumerateDeviceExtensionProperties(_physicalDevice, nullptr, &extensionCount, nullptr);
+            auto availableExtensions = std::make_unique<VkExtensionProperties[]>(extensionCount);
+            dispatch::instance.vkEnumerateDeviceExtensionProperties(_physicalDevice, nullptr, &extensionCount, availableExtensions.get());
+
+            for (auto ext : config::optionalDeviceExtensions()) {
+                // memory budget queries go through the instance-level properties2 entry point
+                if (strcmp(ext, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0 &&
+                    !utility::containsExtension(_enabledExtensions, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+                    continue;
+                }
+                for (int i = 0; i < extensionCount; ++i) {
+                    if (strcmp(ext, availableExtensions[i].extensionName) == 0) {
+                        requiredDeviceExtensions.push_back(ext);
+                        break;
+                    }
+                }
+            }
+        }
+
         float queuePriority = 1.0f;
 
         VkDeviceQueueCreateInfo queueCreateInfo = {};
@@ -311,34 +414,51 @@ namespace steps {
         queueCreateInfo.pQueuePriorities = &queuePriority;
 
         VkPhysicalDeviceFeatures requiredDeviceFeatures = {};
-        std::vector<const char *> requiredLayers = config::requiredLayers();
+        { // optional features, enabled when the device has them
+            VkPhysicalDeviceFeatures availableFeatures = {};
+            dispatch::instance.vkGetPhysicalDeviceFeatures(_physicalDevice, &availableFeatures);
+            requiredDeviceFeatures.pipelineStatisticsQuery = availableFeatures.pipelineStatisticsQuery;
+        }
+        // the extension requires its main feature, so there's nothing to query first
+        VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures = {};
+        conditionalRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+        conditionalRenderingFeatures.conditionalRendering = VK_TRUE;
 
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        if (utility::containsExtension(requiredDeviceExtensions, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME)) {
+            createInfo.pNext = &conditionalRenderingFeatures;
+        }
         createInfo.pQueueCreateInfos = &queueCreateInfo;
         createInfo.queueCreateInfoCount = 1;
         createInfo.pEnabledFeatures = &requiredDeviceFeatures;
-        createInfo.enabledLayerCount = requiredLayers.size();
-        createInfo.ppEnabledLayerNames = requiredLayers.data();
+        createInfo.enabledLayerCount = _enabledLayers.size();
+        createInfo.ppEnabledLayerNames = _enabledLayers.data();
         createInfo.enabledExtensionCount = requiredDeviceExtensions.size();
         createInfo.ppEnabledExtensionNames = requiredDeviceExtensions.data();
 
-        VkResult result = vkCreateDevice(_physicalDevice, &createInfo, nullptr, &_device);
+        VkResult result = dispatch::instance.vkCreateDevice(_physicalDevice, &createInfo, host_allocator::callbacks(), &_device);
         assert(result == VK_SUCCESS);
+        dispatch::loadDevice(_device);
+        _enabledDeviceExtensions = requiredDeviceExtensions;
+        _enabledDeviceFeatures = requiredDeviceFeatures;
+
+        dispatch::device.vkGetDeviceQueue(_device, _queueFamilyIndex, 0, &_graphicsQueue);
 
-        vkGetDeviceQueue(_device, _queueFamilyIndex, 0, &_graphicsQueue);
+        bool budgetSupported = utility::containsExtension(_enabledDeviceExtensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        device_memory::initialize(_physicalDevice, budgetSupported);
     }
 
-    void createSwapChain() {
+    void createSwapChain(Output &output) {
         VkSurfaceCapabilitiesKHR surfaceCapabilities;
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_physicalDevice, _surface, &surfaceCapabilities);
+        dispatch::instance.vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_physicalDevice, output.surface, &surfaceCapabilities);
 
         if (surfaceCapabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
-            _swapChainExtent = surfaceCapabilities.currentExtent;
+            output.extent = surfaceCapabilities.currentExtent;
         } else {
             std::pair<uint32_t, uint32_t> windowSize = glfw::windowSize();
-            _swapChainExtent.width = std::max(surfaceCapabilities.minImageExtent.width, std::min(surfaceCapabilities.maxImageExtent.width, windowSize.first));
-            _swapChainExtent.height = std::max(surfaceCapabilities.minImageExtent.height, std::min(surfaceCapabilities.maxImageExtent.height, windowSize.second));
+            output.extent.width = std::max(surfaceCapabilities.minImageExtent.width, std::min(surfaceCapabilities.maxImageExtent.width, windowSize.first));
+            output.extent.height = std::max(surfaceCapabilities.minImageExtent.height, std::min(surfaceCapabilities.maxImageExtent.height, windowSize.second));
         }
 
         uint32_t imageCount = 2;
@@ -348,17 +468,17 @@ namespace steps {
         { // list all formats
             uint32_t formatCount = 0;
             std::unique_ptr<VkSurfaceFormatKHR[]> formats = nullptr;
-            vkGetPhysicalDeviceSurfaceFormatsKHR(_physicalDevice, _surface, &formatCount, nullptr);
+            dispatch::instance.vkGetPhysicalDeviceSurfaceFormatsKHR(_physicalDevice, output.surface, &formatCount, nullptr);
             std::cout << formatCount << " formats found:\n";
             if (formatCount > 0) {
                 formats = std::make_unique<VkSurfaceFormatKHR[]>(formatCount);
-                vkGetPhysicalDeviceSurfaceFormatsKHR(_physicalDevice, _surface, &formatCount, formats.get());
+                dispatch::instance.vkGetPhysicalDeviceSurfaceFormatsKHR(_physicalDevice, output.surface, &formatCount, formats.get());
 
                 bool foundFormat = false;
                 for (int i = 0; i < formatCount; ++i) {
                     std::cout << "-> " << formats[i].format << ", " << formats[i].colorSpace << std::endl;
                     if (formats[i].format == config::preferredFormat()) {
-                        _swapChainImageFormat = formats[i];
+                        output.format = formats[i];
                         foundFormat = true;
                     }
                 }
@@ -370,16 +490,19 @@ namespace steps {
         { // list all present modes
             uint32_t presentModeCount = 0;
             std::unique_ptr<VkPresentModeKHR[]> presentModes = nullptr;
-            vkGetPhysicalDeviceSurfacePresentModesKHR(_physicalDevice, _surface, &presentModeCount, nullptr);
+            dispatch::instance.vkGetPhysicalDeviceSurfacePresentModesKHR(_physicalDevice, output.surface, &presentModeCount, nullptr);
             std::cout << presentModeCount << " present modes found:\n";
             if (presentModeCount > 0) {
                 presentModes = std::make_unique<VkPresentModeKHR[]>(presentModeCount);
-                vkGetPhysicalDeviceSurfacePresentModesKHR(_physicalDevice, _surface, &presentModeCount, presentModes.get());
+                dispatch::instance.vkGetPhysicalDeviceSurfacePresentModesKHR(_physicalDevice, output.surface, &presentModeCount, presentModes.get());
 
                 for (int i = 0; i < presentModeCount; ++i) {
                     std::cout << "-> " << presentModes[i] << std::endl;
-                    if (presentModes[i] == config::preferredPresentMode()) {
-                        surfacePresentMode = presentModes[i];
+                }
+                for (VkPresentModeKHR candidate : config::presentModes()) {
+                    if (std::find(presentModes.get(), presentModes.get() + presentModeCount, candidate) != presentModes.get() + presentModeCount) {
+                        surfacePresentMode = candidate;
+                        break;
                     }
                 }
                 assert(surfacePresentMode != VK_PRESENT_MODE_MAX_ENUM_KHR);
@@ -390,35 +513,43 @@ namespace steps {
 
         VkSwapchainCreateInfoKHR createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        createInfo.surface = _surface;
+        createInfo.surface = output.surface;
         createInfo.minImageCount = imageCount;
-        createInfo.imageFormat = _swapChainImageFormat.format;
-        createInfo.imageColorSpace = _swapChainImageFormat.colorSpace;
-        createInfo.imageExtent = _swapChainExtent;
+        createInfo.imageFormat = output.format.format;
+        createInfo.imageColorSpace = output.format.colorSpace;
+        createInfo.imageExtent = output.extent;
         createInfo.imageArrayLayers = 1;
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        if (frame_capture::enabled()) {
+            // presented images are copied out for capture
+            assert(surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
         createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
         createInfo.preTransform = surfaceCapabilities.currentTransform;
         createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
         createInfo.presentMode = surfacePresentMode;
         createInfo.clipped = VK_TRUE;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        // null on first creation; lets a recreated swapchain take over its resources
+        createInfo.oldSwapchain = output.swapChain.get();
 
-        VkResult result = vkCreateSwapchainKHR(_device, &createInfo, nullptr, &_swapChain);
+        VkSwapchainKHR swapChain;
+        VkResult result = dispatch::device.vkCreateSwapchainKHR(_device, &createInfo, host_allocator::callbacks(), &swapChain);
         assert(result == VK_SUCCESS);
+        output.imageViews.clear();
+        output.swapChain = handles::Swapchain(_device, swapChain);
 
-        std::vector<VkImage> swapChainImages;
         uint32_t swapChainImageCount;
-        vkGetSwapchainImagesKHR(_device, _swapChain, &swapChainImageCount, nullptr);
-        swapChainImages.resize(swapChainImageCount);
-        vkGetSwapchainImagesKHR(_device, _swapChain, &swapChainImageCount, swapChainImages.data());
+        dispatch::device.vkGetSwapchainImagesKHR(_device, output.swapChain.get(), &swapChainImageCount, nullptr);
+        output.images.resize(swapChainImageCount);
+        dispatch::device.vkGetSwapchainImagesKHR(_device, output.swapChain.get(), &swapChainImageCount, output.images.data());
 
-        for (const auto& image : swapChainImages) {
+        for (const auto& image : output.images) {
             VkImageViewCreateInfo createInfo = {};
             createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
             createInfo.image = image;
             createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            createInfo.format = _swapChainImageFormat.format;
+            createInfo.format = output.format.format;
             createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
             createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
             createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -429,70 +560,66 @@ namespace steps {
             createInfo.subresourceRange.baseArrayLayer = 0;
             createInfo.subresourceRange.layerCount = 1;
 
-            _swapChainImageViews.push_back({});
-            VkResult result = vkCreateImageView(_device, &createInfo, nullptr, &_swapChainImageViews.back());
+            VkImageView imageView;
+            VkResult result = dispatch::device.vkCreateImageView(_device, &createInfo, host_allocator::callbacks(), &imageView);
             assert(result == VK_SUCCESS);
+            output.imageViews.emplace_back(_device, imageView);
         }
     }
-}
-
-namespace scene {
-    struct ShaderObjects {
-    public:
-        ShaderObjects(const std::string &vertFileName, const std::string &fragFileName) {
-            vertShaderModule = utility::shaderModuleFromFile(vertFileName);
-            fragShaderModule = utility::shaderModuleFromFile(fragFileName);
 
-            _vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-            _vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-            _vertShaderStageInfo.module = vertShaderModule;
-            _vertShaderStageInfo.pName = "main";
-
-            _fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-            _fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-            _fragShaderStageInfo.module = fragShaderModule;
-            _fragShaderStageInfo.pName = "main";
-
-            _stages = { _vertShaderStageInfo, _fragShaderStageInfo };
-        }
-
-        ~ShaderObjects() {
-            vkDestroyShaderModule(_device, vertShaderModule, nullptr);
-            vkDestroyShaderModule(_device, fragShaderModule, nullptr);
-        }
-
-        uint32_t numStages() {
-            return _stages.size();
-        }
-
-        const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages() {
-            return _stages;
+    void createSwapChains() {
+        profiler::Scope scope("createSwapChains");
+        for (Output &output : _outputs) {
+            createSwapChain(output);
         }
+    }
+}
 
-    private:
-        VkShaderModule vertShaderModule = VK_NULL_HANDLE;
-        VkShaderModule fragShaderModule = VK_NULL_HANDLE;
-        VkPipelineShaderStageCreateInfo _vertShaderStageInfo = {};
-        VkPipelineShaderStageCreateInfo _fragShaderStageInfo = {};
-        std::vector<VkPipelineShaderStageCreateInfo> _stages;
+namespace scene {
+    // one per swapchain format; windows on different displays may not share one
+    struct FormatRenderPass {
+        VkFormat format;
+        handles::RenderPass renderPass;
     };
-
-    VkRenderPass _renderPass;
-    std::unique_ptr<ShaderObjects> _shaderObjects;
-    VkPipelineLayout _pipelineLayout;
-    VkPipeline _graphicsPipeline;
-    VkCommandPool _commandPool;
+    std::vector<FormatRenderPass> _renderPasses;
+    std::unique_ptr<shader_module::ShaderObjects> _shaderObjects;
+    handles::PipelineLayout _pipelineLayout;
+    pipeline_cache::PipelineKey _pipelineKey;
+    // same geometry, drawn only to count samples for occlusion queries
+    pipeline_cache::PipelineKey _occlusionKey;
+    handles::CommandPool _commandPool;
 
     const int MAX_FRAMES_IN_FLIGHT = 2;
-    std::vector<VkSemaphore> _imageAvailableSemaphores;
-    std::vector<VkSemaphore> _renderFinishedSemaphores;
-    std::vector<VkFence> _inFlightFences;
+    // one per frame in flight, signaled by the frame's single submit and waited
+    // on by its single present of every swapchain
+    std::vector<handles::Semaphore> _renderFinishedSemaphores;
+    std::vector<handles::Fence> _inFlightFences;
+
+    // scratch for batching a frame's acquires into one submit and one present
+    std::vector<uint32_t> _imageIndices;
+    std::vector<VkSemaphore> _waitSemaphores;
+    std::vector<VkPipelineStageFlags> _waitStages;
+    std::vector<VkCommandBuffer> _submitCommandBuffers;
+    // present arrays cover only the outputs acquired this frame
+    std::vector<size_t> _presentOutputs;
+    std::vector<VkSwapchainKHR> _presentSwapChains;
+    std::vector<uint32_t> _presentImageIndices;
+    std::vector<VkResult> _presentResults;
+
+    // draw parameters for each scene object, indexed by scene_objects::ObjectId
+    struct ObjectDraw {
+        uint32_t vertexCount;
+        uint32_t firstVertex;
+    };
+    std::vector<ObjectDraw> _objectDraws;
+    std::vector<scene_objects::ObjectId> _visibleObjects;
+    const std::vector<scene_objects::ObjectId> _noObjects;
 
-    void createRenderPass() {
+    VkRenderPass createRenderPass(VkFormat format) {
         VkRenderPassCreateInfo renderPassInfo = {};
         {
             VkAttachmentDescription colorAttachment = {};
-            colorAttachment.format = _swapChainImageFormat.format;
+            colorAttachment.format = format;
             colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
             colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
             colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -527,92 +654,15 @@ namespace scene {
             renderPassInfo.pDependencies = &dependency;
         }
 
-        VkResult result = vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass);
+        VkRenderPass renderPass;
+        VkResult result = dispatch::device.vkCreateRenderPass(_device, &renderPassInfo, host_allocator::callbacks(), &renderPass);
         assert(result == VK_SUCCESS);
+        _renderPasses.push_back({ format, handles::RenderPass(_device, renderPass) });
+        return renderPass;
     }
 
     void createGraphicsPipeline() {
-        _shaderObjects = std::make_unique<ShaderObjects>("triangle_vert.spv", "color_frag.spv");
-
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 0;
-        vertexInputInfo.pVertexBindingDescriptions = nullptr; // no vertex data, yet
-        vertexInputInfo.vertexAttributeDescriptionCount = 0;
-        vertexInputInfo.pVertexAttributeDescriptions = nullptr; // no vertex data, yet
-
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-        VkPipelineViewportStateCreateInfo viewportState = {};
-        {
-            VkViewport viewport = {};
-            viewport.x = 0.0f;
-            viewport.y = 0.0f;
-            viewport.width = (float)_swapChainExtent.width;
-            viewport.height = (float)_swapChainExtent.height;
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-
-            VkRect2D scissor = {};
-            scissor.offset = {0, 0};
-            scissor.extent = _swapChainExtent;
-
-            viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-            viewportState.viewportCount = 1;
-            viewportState.pViewports = &viewport;
-            viewportState.scissorCount = 1;
-            viewportState.pScissors = &scissor;
-        }
-
-        VkPipelineRasterizationStateCreateInfo rasterizer = {};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
-        rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-        rasterizer.depthBiasClamp = 0.0f; // Optional
-        rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-        VkPipelineMultisampleStateCreateInfo multisampling = {};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-        multisampling.minSampleShading = 1.0f; // Optional
-        multisampling.pSampleMask = nullptr; // Optional
-        multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-        multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-        // TODO: VkPipelineDepthStencilStateCreateInfo
-
-        VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;
-        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
-
-        VkPipelineColorBlendStateCreateInfo colorBlending = {};
-        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
-        colorBlending.blendConstants[0] = 0.0f; // Optional
-        colorBlending.blendConstants[1] = 0.0f; // Optional
-        colorBlending.blendConstants[2] = 0.0f; // Optional
-        colorBlending.blendConstants[3] = 0.0f; // Optional
-
-        // TODO: VkPipelineDynamicStateCreateInfo
+        _shaderObjects = std::make_unique<shader_module::ShaderObjects>(_device, "triangle_vert.spv", "color_frag.spv");
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -622,52 +672,104 @@ namespace scene {
         pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
 
         {
-            VkResult result = vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout);
+            VkPipelineLayout pipelineLayout;
+            VkResult result = dispatch::device.vkCreatePipelineLayout(_device, &pipelineLayoutInfo, host_allocator::callbacks(), &pipelineLayout);
             assert(result == VK_SUCCESS);
+            _pipelineLayout = handles::PipelineLayout(_device, pipelineLayout);
         }
 
-        VkGraphicsPipelineCreateInfo pipelineInfo = {};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = _shaderObjects->numStages();
-        pipelineInfo.pStages = _shaderObjects->shaderStages().data();
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = nullptr; // Optional
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = nullptr; // Optional
-        pipelineInfo.layout = _pipelineLayout;
-        pipelineInfo.renderPass = _renderPass;
-        pipelineInfo.subpass = 0;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-        pipelineInfo.basePipelineIndex = -1; // Optional
+        // no vertex data, yet; the rest is the key's defaults
+        _pipelineKey = pipeline_cache::PipelineKey();
+        _pipelineKey.setShaders(*_shaderObjects);
+        _pipelineKey.layout = _pipelineLayout.get();
+        _pipelineKey.cullMode = VK_CULL_MODE_BACK_BIT;
+        _pipelineKey.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        _pipelineKey.subpass = 0;
+
+        _occlusionKey = _pipelineKey;
+        _occlusionKey.colorWriteMask = 0;
+        _occlusionKey.depthWrite = false;
+    }
 
-        {
-            VkResult result = vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline);
-            assert(result == VK_SUCCESS);
+    // the keys leave the render pass open; each output draws with its own
+    pipeline_cache::PipelineKey keyFor(const pipeline_cache::PipelineKey &key, VkRenderPass renderPass) {
+        pipeline_cache::PipelineKey result = key;
+        result.renderPass = renderPass;
+        return result;
+    }
+
+    // created along with their pipelines rather than on the first frame that draws them
+    VkRenderPass renderPassFor(VkFormat format) {
+        for (const FormatRenderPass &entry : _renderPasses) {
+            if (entry.format == format) {
+                return entry.renderPass.get();
+            }
+        }
+        VkRenderPass renderPass = createRenderPass(format);
+        pipeline_cache::get(keyFor(_pipelineKey, renderPass));
+        if (gpu_queries::occlusionCulling()) {
+            pipeline_cache::get(keyFor(_occlusionKey, renderPass));
         }
+        sprite_batch::prepare(renderPass);
+        return renderPass;
     }
 
-    void createFramebuffers() {
-        _swapChainFramebuffers.resize(_swapChainImageViews.size());
+    void createRenderPasses() {
+        for (Output &output : _outputs) {
+            output.renderPass = renderPassFor(output.format.format);
+        }
+    }
 
-        for (int i = 0; i < _swapChainImageViews.size(); ++i) {
+    void createFramebuffers(Output &output) {
+        for (int i = 0; i < output.imageViews.size(); ++i) {
             VkFramebufferCreateInfo framebufferInfo = {};
+            VkImageView attachments[] = { output.imageViews[i].get() };
             {
-                VkImageView attachments[] = { _swapChainImageViews[i] };
                 framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-                framebufferInfo.renderPass = _renderPass;
+                framebufferInfo.renderPass = output.renderPass;
                 framebufferInfo.attachmentCount = 1;
                 framebufferInfo.pAttachments = attachments;
-                framebufferInfo.width = _swapChainExtent.width;
-                framebufferInfo.height = _swapChainExtent.height;
+                framebufferInfo.width = output.extent.width;
+                framebufferInfo.height = output.extent.height;
                 framebufferInfo.layers = 1;
             }
 
-            VkResult result = vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_swapChainFramebuffers[i]);
+            VkFramebuffer framebuffer;
+            VkResult result = dispatch::device.vkCreateFramebuffer(_device, &framebufferInfo, host_allocator::callbacks(), &framebuffer);
             assert(result == VK_SUCCESS);
+            output.framebuffers.emplace_back(_device, framebuffer);
+        }
+    }
+
+    void createFramebuffers() {
+        for (Output &output : _outputs) {
+            createFramebuffers(output);
+        }
+    }
+
+    // returns false while the window is minimized and there is nothing to present to
+    bool recreateSwapChain(Output &output) {
+        VkSurfaceCapabilitiesKHR surfaceCapabilities;
+        dispatch::instance.vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_physicalDevice, output.surface, &surfaceCapabilities);
+        if (surfaceCapabilities.currentExtent.width == 0 || surfaceCapabilities.currentExtent.height == 0) {
+            return false;
+        }
+
+        // frames in flight may still render to the old images: the released framebuffers,
+        // views and the retired swapchain go through the deletion queue and outlive them
+        output.framebuffers.clear();
+        steps::createSwapChain(output);
+        output.renderPass = renderPassFor(output.format.format);
+        createFramebuffers(output);
+        output.imagesInFlight.assign(output.imageViews.size(), VK_NULL_HANDLE);
+        return true;
+    }
+
+    void recreateStaleSwapChains() {
+        for (Output &output : _outputs) {
+            if (output.stale && recreateSwapChain(output)) {
+                output.stale = false;
+            }
         }
     }
 
@@ -676,65 +778,159 @@ namespace scene {
             VkCommandPoolCreateInfo poolInfo = {};
             poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
             poolInfo.queueFamilyIndex = _queueFamilyIndex;
-            poolInfo.flags = 0; // Optional
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // re-recorded every frame
 
-            VkResult result = vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool);
+            VkCommandPool commandPool;
+            VkResult result = dispatch::device.vkCreateCommandPool(_device, &poolInfo, host_allocator::callbacks(), &commandPool);
             assert(result == VK_SUCCESS);
+            _commandPool = handles::CommandPool(_device, commandPool);
         }
 
-        _commandBuffers.resize(_swapChainFramebuffers.size());
+        // one per output per frame in flight, recorded once the slot's previous frame has retired
+        _commandBuffers.resize(MAX_FRAMES_IN_FLIGHT * _outputs.size());
 
         {
             VkCommandBufferAllocateInfo allocInfo = {};
             allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            allocInfo.commandPool = _commandPool;
+            allocInfo.commandPool = _commandPool.get();
             allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
             allocInfo.commandBufferCount = (uint32_t)_commandBuffers.size();
 
-            VkResult result = vkAllocateCommandBuffers(_device, &allocInfo, _commandBuffers.data());
+            VkResult result = dispatch::device.vkAllocateCommandBuffers(_device, &allocInfo, _commandBuffers.data());
             assert(result == VK_SUCCESS);
         }
+    }
 
-        for (int i = 0; i < _commandBuffers.size(); ++i) {
-            {
-                VkCommandBufferBeginInfo beginInfo = {};
-                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-                beginInfo.flags = 0; // Optional
-                beginInfo.pInheritanceInfo = nullptr; // Optional
+    // only the primary output runs the GPU queries; the others draw the same
+    // scene, gated by the occlusion results the primary one produces
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, const Output &output, uint32_t imageIndex, uint32_t syncIndex, bool primary) {
+        {
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            beginInfo.pInheritanceInfo = nullptr; // Optional
 
-                VkResult result = vkBeginCommandBuffer(_commandBuffers[i], &beginInfo);
-                assert(result == VK_SUCCESS);
-            }
+            VkResult result = dispatch::device.vkBeginCommandBuffer(commandBuffer, &beginInfo);
+            assert(result == VK_SUCCESS);
+        }
 
-            VkRenderPassBeginInfo renderPassInfo = {};
-            {
-                VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
-                renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-                renderPassInfo.renderPass = _renderPass;
-                renderPassInfo.framebuffer = _swapChainFramebuffers[i];
-                renderPassInfo.renderArea.offset = {0, 0};
-                renderPassInfo.renderArea.extent = _swapChainExtent;
-                renderPassInfo.clearValueCount = 1;
-                renderPassInfo.pClearValues = &clearColor;
+        const bool occlusionCulling = primary && gpu_queries::occlusionCulling();
+        if (primary) {
+            gpu_queries::beginFrame(commandBuffer, syncIndex, occlusionCulling ? _visibleObjects : _noObjects);
+        }
+
+        VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
+        VkRenderPassBeginInfo renderPassInfo = {};
+        {
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = output.renderPass;
+            renderPassInfo.framebuffer = output.framebuffers[imageIndex].get();
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = output.extent;
+            renderPassInfo.clearValueCount = 1;
+            renderPassInfo.pClearValues = &clearColor;
+        }
+
+        dispatch::device.vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        {
+            VkViewport viewport = {};
+            viewport.x = 0.0f;
+            viewport.y = 0.0f;
+            viewport.width = (float)output.extent.width;
+            viewport.height = (float)output.extent.height;
+            viewport.minDepth = 0.0f;
+            viewport.maxDepth = 1.0f;
+            dispatch::device.vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+            VkRect2D scissor = {};
+            scissor.offset = {0, 0};
+            scissor.extent = output.extent;
+            dispatch::device.vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        }
+
+        if (!_visibleObjects.empty()) {
+            if (occlusionCulling) {
+                // proxies first: their results decide the real draws of the next frame
+                gpu_queries::beginPass(commandBuffer, gpu_queries::Pass::OcclusionProxies);
+                dispatch::device.vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_cache::get(keyFor(_occlusionKey, output.renderPass)));
+                for (scene_objects::ObjectId id : _visibleObjects) {
+                    if (gpu_queries::beginOcclusionQuery(commandBuffer, id)) {
+                        dispatch::device.vkCmdDraw(commandBuffer, _objectDraws[id].vertexCount, 1, _objectDraws[id].firstVertex, 0);
+                        gpu_queries::endOcclusionQuery(commandBuffer, id);
+                    }
+                }
+                gpu_queries::endPass(commandBuffer, gpu_queries::Pass::OcclusionProxies);
+            }
+            if (primary) {
+                gpu_queries::beginPass(commandBuffer, gpu_queries::Pass::Scene);
             }
 
-            vkCmdBeginRenderPass(_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            dispatch::device.vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_cache::get(keyFor(_pipelineKey, output.renderPass)));
+            for (scene_objects::ObjectId id : _visibleObjects) {
+                if (gpu_queries::beginConditionalDraw(commandBuffer, id)) {
+                    dispatch::device.vkCmdDraw(commandBuffer, _objectDraws[id].vertexCount, 1, _objectDraws[id].firstVertex, 0);
+                    gpu_queries::endConditionalDraw(commandBuffer);
+                }
+            }
 
-            vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
-            vkCmdDraw(_commandBuffers[i], 3, 1, 0, 0);
-            vkCmdEndRenderPass(_commandBuffers[i]);
-            {
-                VkResult result = vkEndCommandBuffer(_commandBuffers[i]);
-                assert(result == VK_SUCCESS);
+            if (primary) {
+                gpu_queries::endPass(commandBuffer, gpu_queries::Pass::Scene);
             }
         }
+
+        if (primary) {
+            gpu_queries::beginPass(commandBuffer, gpu_queries::Pass::Sprites);
+        }
+        sprite_batch::record(commandBuffer, output.renderPass, output.extent);
+        if (primary) {
+            gpu_queries::endPass(commandBuffer, gpu_queries::Pass::Sprites);
+        }
+
+        dispatch::device.vkCmdEndRenderPass(commandBuffer);
+
+        if (primary) {
+            gpu_queries::endFrame(commandBuffer);
+        }
+        {
+            VkResult result = dispatch::device.vkEndCommandBuffer(commandBuffer);
+            assert(result == VK_SUCCESS);
+        }
     }
 
-    void createSyncObjects() {
-        _imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        _renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        _inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    void registerObjects() {
+        // the triangle's vertices are in clip space until there is a camera
+        const float min[3] = { -0.5f, -0.5f, 0.0f };
+        const float max[3] = { 0.5f, 0.5f, 0.0f };
+        scene_objects::ObjectId triangle = scene_objects::add(scene_objects::boundsFromBox(min, max));
+        if (_objectDraws.size() <= triangle) {
+            _objectDraws.resize(triangle + 1);
+        }
+        _objectDraws[triangle] = { 3, 0 };
+    }
+
+    void cullObjects() {
+        // identity view projection: the frustum is the clip volume itself
+        const float viewProjection[16] = {
+            1.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 1.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 1.0f,
+        };
+        _visibleObjects.clear();
+        scene_objects::cull(scene_objects::frustumFromMatrix(viewProjection), _visibleObjects);
+    }
+
+    void drawOverlay(const vulkan::FrameState &state) {
+        // crosshair following the cursor
+        const uint32_t color = sprite_batch::rgba(255, 255, 255, 192);
+        const float x = (float)(state.cursorX * state.pixelScaleX);
+        const float y = (float)(state.cursorY * state.pixelScaleY);
+        sprite_batch::line(x - 10.0f, y, x + 10.0f, y, 2.0f, color);
+        sprite_batch::line(x, y - 10.0f, x, y + 10.0f, 2.0f, color);
+    }
 
+    void createSyncObjects() {
         VkSemaphoreCreateInfo semaphoreInfo = {};
         semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
@@ -743,147 +939,329 @@ namespace scene {
         fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            {
-                VkResult result = vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i]);
+            for (Output &output : _outputs) {
+                VkSemaphore semaphore;
+                VkResult result = dispatch::device.vkCreateSemaphore(_device, &semaphoreInfo, host_allocator::callbacks(), &semaphore);
                 assert(result == VK_SUCCESS);
+                output.imageAvailableSemaphores.emplace_back(_device, semaphore);
             }
             {
-                VkResult result = vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]);
+                VkSemaphore semaphore;
+                VkResult result = dispatch::device.vkCreateSemaphore(_device, &semaphoreInfo, host_allocator::callbacks(), &semaphore);
                 assert(result == VK_SUCCESS);
+                _renderFinishedSemaphores.emplace_back(_device, semaphore);
             }
             {
-                VkResult result = vkCreateFence(_device, &fenceInfo, nullptr, &_inFlightFences[i]);
+                VkFence fence;
+                VkResult result = dispatch::device.vkCreateFence(_device, &fenceInfo, host_allocator::callbacks(), &fence);
                 assert(result == VK_SUCCESS);
+                _inFlightFences.emplace_back(_device, fence);
             }
         }
+
+        for (Output &output : _outputs) {
+            output.imagesInFlight.resize(output.imageViews.size(), VK_NULL_HANDLE);
+        }
+
+        _imageIndices.resize(_outputs.size());
     }
 }
 
 namespace vulkan {
+    void configure(const Settings &settings) {
+        _settings = settings;
+    }
+
     void prepareEnvironment() {
-        setenv("VK_ICD_FILENAMES", VK_ICD_FILENAMES, 1);
-        setenv("VK_LAYER_PATH", VK_LAYER_PATH, 1);
-        setenv("VK_LOADER_DEBUG", "all", 1);
+        // values already in the environment win, e.g. to run on lavapipe or SwiftShader,
+        // or to keep the loader quiet in regression runs
+#ifdef VK_ICD_FILENAMES // built against the bundled SDK rather than an installed loader
+        setenv("VK_ICD_FILENAMES", VK_ICD_FILENAMES, 0);
+        setenv("VK_LAYER_PATH", VK_LAYER_PATH, 0);
+#endif
+        setenv("VK_LOADER_DEBUG", "all", 0);
     }
 
     void initialize() {
+        profiler::Scope scope("vulkan::initialize");
         steps::createInstance();
         steps::setupDebugCallback();
-        steps::setupSurface();
+        steps::setupSurfaces();
         steps::setupDevice();
-        steps::createSwapChain();
+        steps::createSwapChains();
+
+        pipeline_cache::initialize(_device);
+
+        // only the primary window is captured
+        _captureExtent = _outputs.front().extent;
+        frame_capture::initialize(_device, _queueFamilyIndex, _captureExtent, _outputs.front().format.format);
     }
 
     void shutdown() {
-        vkDeviceWaitIdle(_device);
+        // the device is going away; everything still pending must go now
+        dispatch::device.vkDeviceWaitIdle(_device);
 
-        for (auto imageView : _swapChainImageViews) {
-            vkDestroyImageView(_device, imageView, nullptr);
+        frame_capture::shutdown();
+        pipeline_cache::shutdown();
+
+        for (Output &output : _outputs) {
+            output.imageViews.clear();
+            output.images.clear();
+            output.swapChain.reset();
         }
-        _swapChainImageViews.clear();
 
-        vkDestroySwapchainKHR(_device, _swapChain, nullptr);
-        _swapChain = VK_NULL_HANDLE;
+        deletion_queue::flush();
+
+        device_memory::logUsage();
+        device_memory::shutdown();
 
-        vkDestroyDevice(_device, nullptr);
+        dispatch::device.vkDestroyDevice(_device, host_allocator::callbacks());
         _device = VK_NULL_HANDLE;
+        dispatch::unloadDevice();
 
-        vkDestroySurfaceKHR(_instance, _surface, nullptr);
-        _surface = VK_NULL_HANDLE;
+        for (Output &output : _outputs) {
+            dispatch::instance.vkDestroySurfaceKHR(_instance, output.surface, host_allocator::callbacks());
+        }
+        _outputs.clear();
 
-        debug_utils::DestroyDebugUtilsMessengerEXT(_instance, _debugMessenger, nullptr);
+        debug_utils::DestroyDebugUtilsMessengerEXT(_instance, _debugMessenger, host_allocator::callbacks());
         _debugMessenger = VK_NULL_HANDLE;
 
-        vkDestroyInstance(_instance, nullptr);
+        dispatch::instance.vkDestroyInstance(_instance, host_allocator::callbacks());
         _instance = VK_NULL_HANDLE;
+        dispatch::unloadInstance();
+        // anything still in use here was leaked by the driver or by us
+        host_allocator::logUsage();
+        _enabledDeviceExtensions.clear();
+        _enabledExtensions.clear();
+        _enabledLayers.clear();
+        _enabledDeviceFeatures = {};
     }
 
     void setupScene() {
-        scene::createRenderPass();
+        profiler::Scope scope("vulkan::setupScene");
         scene::createGraphicsPipeline();
+        sprite_batch::initialize(_device, scene::MAX_FRAMES_IN_FLIGHT);
+        scene::createRenderPasses();
         scene::createFramebuffers();
         scene::createCommandPool();
         scene::createSyncObjects();
-    }
+        scene::registerObjects();
 
-    void tearDownScene() {
-        for (VkSemaphore semaphore : scene::_renderFinishedSemaphores) {
-            vkDestroySemaphore(_device, semaphore, nullptr);
-        }
-        for (VkSemaphore semaphore : scene::_imageAvailableSemaphores) {
-            vkDestroySemaphore(_device, semaphore, nullptr);
-        }
-        for (VkFence fence : scene::_inFlightFences) {
-            vkDestroyFence(_device, fence, nullptr);
-        }
+        gpu_queries::Features queryFeatures;
+        queryFeatures.pipelineStatistics = _enabledDeviceFeatures.pipelineStatisticsQuery == VK_TRUE;
+        queryFeatures.conditionalRendering = utility::containsExtension(_enabledDeviceExtensions, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+        if (profiler::enabled()) { // GPU pass timings for the trace
+            VkPhysicalDeviceProperties deviceProperties;
+            dispatch::instance.vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
 
-        vkDestroyCommandPool(_device, scene::_commandPool, nullptr);
+            uint32_t queueFamilyCount = 0;
+            dispatch::instance.vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, nullptr);
+            auto queueFamilies = std::make_unique<VkQueueFamilyProperties[]>(queueFamilyCount);
+            dispatch::instance.vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, queueFamilies.get());
 
-         for (VkFramebuffer framebuffer : _swapChainFramebuffers) {
-            vkDestroyFramebuffer(_device, framebuffer, nullptr);
+            queryFeatures.timestampValidBits = queueFamilies[_queueFamilyIndex].timestampValidBits;
+            if (queryFeatures.timestampValidBits > 0) {
+                queryFeatures.timestampPeriod = deviceProperties.limits.timestampPeriod;
+            }
         }
+        gpu_queries::initialize(_device, queryFeatures, scene::MAX_FRAMES_IN_FLIGHT);
+    }
 
-        vkDestroyPipeline(_device, scene::_graphicsPipeline, nullptr);
-        scene::_graphicsPipeline = VK_NULL_HANDLE;
+    void tearDownScene() {
+        // released objects are destroyed once the frames using them retire
+        gpu_queries::shutdown();
+        scene_objects::clear();
+        scene::_objectDraws.clear();
+        scene::_visibleObjects.clear();
+        scene::_inFlightFences.clear();
+        scene::_renderFinishedSemaphores.clear();
+        scene::_imageIndices.clear();
+        scene::_waitSemaphores.clear();
+        scene::_waitStages.clear();
+        scene::_submitCommandBuffers.clear();
+        scene::_presentOutputs.clear();
+        scene::_presentSwapChains.clear();
+        scene::_presentImageIndices.clear();
+        scene::_presentResults.clear();
+
+        _commandBuffers.clear();
+        scene::_commandPool.reset();
+
+        for (Output &output : _outputs) {
+            output.imagesInFlight.clear();
+            output.imageAvailableSemaphores.clear();
+            output.framebuffers.clear();
+            output.renderPass = VK_NULL_HANDLE;
+        }
 
-        vkDestroyPipelineLayout(_device, scene::_pipelineLayout, nullptr);
-        scene::_pipelineLayout = VK_NULL_HANDLE;
+        sprite_batch::shutdown();
 
-        vkDestroyRenderPass(_device, scene::_renderPass, nullptr);
-        scene::_renderPass = VK_NULL_HANDLE;
+        // every pipeline refers to a render pass being released
+        pipeline_cache::clear();
+        scene::_pipelineKey = pipeline_cache::PipelineKey();
+        scene::_occlusionKey = pipeline_cache::PipelineKey();
+        scene::_pipelineLayout.reset();
+        scene::_renderPasses.clear();
 
         scene::_shaderObjects = nullptr;
     }
 
-    void drawFrame() {
-        static size_t syncIndex = scene::MAX_FRAMES_IN_FLIGHT - 1;
+    void drawFrame(const FrameState &state) {
+        profiler::Scope frameScope("drawFrame");
+        static uint64_t frameIndex = 0;
+        ++frameIndex;
+        const size_t syncIndex = frameIndex % scene::MAX_FRAMES_IN_FLIGHT;
+
+        { // wait until the GPU is done with the last frame that used this slot
+            profiler::Scope scope("wait for frame slot");
+            dispatch::device.vkWaitForFences(_device, 1, scene::_inFlightFences[syncIndex].ptr(), VK_TRUE, UINT64_MAX);
+        }
+
+        // ...which also means every frame up to that one has retired
+        if (frameIndex > scene::MAX_FRAMES_IN_FLIGHT) {
+            deletion_queue::retire(frameIndex - scene::MAX_FRAMES_IN_FLIGHT);
+            frame_capture::collect(frameIndex - scene::MAX_FRAMES_IN_FLIGHT);
+        }
+        gpu_queries::collect((uint32_t)syncIndex);
+        deletion_queue::beginFrame(frameIndex);
+
+        { // CPU-side culling and overlay work doesn't need the swapchain image yet
+            profiler::Scope scope("cull and batch");
+            scene::cullObjects();
+            sprite_batch::begin((uint32_t)syncIndex);
+            scene::drawOverlay(state);
+            sprite_batch::end();
+        }
+
+        size_t primary = _outputs.size();
+        {
+            profiler::Scope scope("acquire");
+            for (size_t i = 0; i < _outputs.size(); ++i) {
+                Output &output = _outputs[i];
+                VkResult result = dispatch::device.vkAcquireNextImageKHR(_device, output.swapChain.get(), UINT64_MAX, output.imageAvailableSemaphores[syncIndex].get(), VK_NULL_HANDLE, &scene::_imageIndices[i]);
+                // a suboptimal image is still acquired and its semaphore signaled; on
+                // any error the semaphore is left alone and must not be waited on
+                output.acquired = result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+                output.stale = output.stale || result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR;
+                utility::reportResult("acquire", i, result, output.lastAcquireResult);
+                if (output.acquired && primary == _outputs.size()) {
+                    primary = i;
+                }
+            }
+        }
 
-        // wait for previous frame before updating the index
-        vkWaitForFences(_device, 1, &scene::_inFlightFences[syncIndex], VK_TRUE, UINT64_MAX);
+        if (primary == _outputs.size()) {
+            // nothing to draw to; the slot's fence stays signaled for its next use
+            scene::recreateStaleSwapChains();
+            return;
+        }
 
-        syncIndex = (syncIndex + 1) % scene::MAX_FRAMES_IN_FLIGHT;
+        // the acquired images may still be rendered to by a frame from another slot
+        for (size_t i = 0; i < _outputs.size(); ++i) {
+            if (!_outputs[i].acquired) {
+                continue;
+            }
+            VkFence &imageInFlight = _outputs[i].imagesInFlight[scene::_imageIndices[i]];
+            if (imageInFlight != VK_NULL_HANDLE) {
+                profiler::Scope scope("wait for image");
+                dispatch::device.vkWaitForFences(_device, 1, &imageInFlight, VK_TRUE, UINT64_MAX);
+            }
+            imageInFlight = scene::_inFlightFences[syncIndex].get();
+        }
 
-        // reset the next fence, since they're initialized in a signaled state
-        vkResetFences(_device, 1, &scene::_inFlightFences[syncIndex]);
+        // fences are created signaled, so only reset the one we are about to submit with
+        dispatch::device.vkResetFences(_device, 1, scene::_inFlightFences[syncIndex].ptr());
 
-        uint32_t imageIndex;
-        vkAcquireNextImageKHR(_device, _swapChain, UINT64_MAX, scene::_imageAvailableSemaphores[syncIndex], VK_NULL_HANDLE, &imageIndex);
+        VkSemaphore signalSemaphores[] = { scene::_renderFinishedSemaphores[syncIndex].get() };
 
-        VkSemaphore signalSemaphores[] = { scene::_renderFinishedSemaphores[syncIndex] };
+        // every acquired window's commands and acquire semaphores go in one
+        // submit; the primary output, the first acquired, is recorded first so
+        // its query results precede the conditional draws of the others
+        scene::_submitCommandBuffers.clear();
+        scene::_waitSemaphores.clear();
+        scene::_waitStages.clear();
+        {
+            profiler::Scope scope("record");
+            for (size_t i = primary; i < _outputs.size(); ++i) {
+                if (!_outputs[i].acquired) {
+                    continue;
+                }
+                VkCommandBuffer commandBuffer = _commandBuffers[syncIndex * _outputs.size() + i];
+                scene::recordCommandBuffer(commandBuffer, _outputs[i], scene::_imageIndices[i], (uint32_t)syncIndex, i == primary);
+                scene::_submitCommandBuffers.push_back(commandBuffer);
+                scene::_waitSemaphores.push_back(_outputs[i].imageAvailableSemaphores[syncIndex].get());
+                scene::_waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+            }
+        }
+
+        // the readback buffers are sized for the window as it was at startup
+        const Output &captured = _outputs.front();
+        if (frame_capture::enabled() && captured.acquired
+            && captured.extent.width == _captureExtent.width && captured.extent.height == _captureExtent.height) {
+            VkCommandBuffer copyCommandBuffer = frame_capture::recordCopy(captured.images[scene::_imageIndices.front()], frameIndex);
+            if (copyCommandBuffer != VK_NULL_HANDLE) {
+                scene::_submitCommandBuffers.push_back(copyCommandBuffer);
+            }
+        }
 
         VkSubmitInfo submitInfo = {};
         {
-            VkSemaphore waitSemaphores[] = { scene::_imageAvailableSemaphores[syncIndex] };
-            VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
             submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.waitSemaphoreCount = 1;
-            submitInfo.pWaitSemaphores = waitSemaphores;
-            submitInfo.pWaitDstStageMask = waitStages;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
+            submitInfo.waitSemaphoreCount = (uint32_t)scene::_waitSemaphores.size();
+            submitInfo.pWaitSemaphores = scene::_waitSemaphores.data();
+            submitInfo.pWaitDstStageMask = scene::_waitStages.data();
+            submitInfo.commandBufferCount = (uint32_t)scene::_submitCommandBuffers.size();
+            submitInfo.pCommandBuffers = scene::_submitCommandBuffers.data();
             submitInfo.signalSemaphoreCount = 1;
             submitInfo.pSignalSemaphores = signalSemaphores;
         }
 
         {
-            VkResult result = vkQueueSubmit(_graphicsQueue, 1, &submitInfo, scene::_inFlightFences[syncIndex]);
+            profiler::Scope scope("submit");
+            VkResult result = dispatch::device.vkQueueSubmit(_graphicsQueue, 1, &submitInfo, scene::_inFlightFences[syncIndex].get());
             assert(result == VK_SUCCESS);
         }
 
+        scene::_presentOutputs.clear();
+        scene::_presentSwapChains.clear();
+        scene::_presentImageIndices.clear();
+        for (size_t i = 0; i < _outputs.size(); ++i) {
+            if (_outputs[i].acquired) {
+                scene::_presentOutputs.push_back(i);
+                scene::_presentSwapChains.push_back(_outputs[i].swapChain.get());
+                scene::_presentImageIndices.push_back(scene::_imageIndices[i]);
+            }
+        }
+        scene::_presentResults.resize(scene::_presentOutputs.size());
+
         VkPresentInfoKHR presentInfo = {};
         {
-            VkSwapchainKHR swapChains[] = { _swapChain };
             presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
             presentInfo.waitSemaphoreCount = 1;
             presentInfo.pWaitSemaphores = signalSemaphores;
-            presentInfo.swapchainCount = 1;
-            presentInfo.pSwapchains = swapChains;
-            presentInfo.pImageIndices = &imageIndex;
-            presentInfo.pResults = nullptr; // Optional
+            presentInfo.swapchainCount = (uint32_t)scene::_presentSwapChains.size();
+            presentInfo.pSwapchains = scene::_presentSwapChains.data();
+            presentInfo.pImageIndices = scene::_presentImageIndices.data();
+            presentInfo.pResults = scene::_presentResults.data();
         }
 
-        vkQueuePresentKHR(_graphicsQueue, &presentInfo);
+        {
+            profiler::Scope scope("present");
+            dispatch::device.vkQueuePresentKHR(_graphicsQueue, &presentInfo);
+        }
+
+        for (size_t k = 0; k < scene::_presentOutputs.size(); ++k) {
+            Output &output = _outputs[scene::_presentOutputs[k]];
+            VkResult result = scene::_presentResults[k];
+            output.stale = output.stale || result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR;
+            utility::reportResult("present", scene::_presentOutputs[k], result, output.lastPresentResult);
+        }
+
+        scene::recreateStaleSwapChains();
+
+        frame_stats::markFramePresented();
 
-        vkQueueWaitIdle(_graphicsQueue);
+        device_memory::logPeriodically(state.time);
     }
 }
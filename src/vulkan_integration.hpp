@@ -1,12 +1,32 @@
-
 #pragma once
 
+#include <cstdint>
+
 namespace vulkan {
+    // per-frame input captured on the main thread and consumed by the renderer
+    struct FrameState {
+        uint64_t frameNumber = 0;
+        double time = 0.0;
+        // in window coordinates, which on HiDPI displays are not swapchain pixels
+        double cursorX = 0.0;
+        double cursorY = 0.0;
+        // framebuffer pixels per window coordinate
+        double pixelScaleX = 1.0;
+        double pixelScaleY = 1.0;
+    };
+
+    struct Settings {
+        // off presents as soon as a frame is done, e.g. to time the renderer rather than the display
+        bool vsync = true;
+    };
+
+    // must be called before initialize()
+    void configure(const Settings &settings);
     void prepareEnvironment();
     void initialize();
     void shutdown();
 
     void setupScene();
     void tearDownScene();
-    void drawFrame();
+    void drawFrame(const FrameState &state);
 }
@@ -0,0 +1,223 @@
+// Compares a regression run of HelloWorld against its recorded references:
+//
+//   RegressionCheck image <capture directory> <golden.ppm> <channel tolerance> <max differing fraction> [--update]
+//   RegressionCheck stats <stats file> <baseline file> <max ratio> [--update]
+//
+// `image` checks every frame_*.ppm of the run against the golden; a pixel
+// differs when any channel is off by more than the tolerance. `stats` fails
+// when a timing written by --stats exceeds its baseline times the ratio.
+// With --update the run's output becomes the new reference instead. A
+// missing reference exits with kMissingReference, which CTest reports as skipped.
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+    const int kMissingReference = 77;
+
+    // timings a run must not regress on; the others are informational
+    const char *kCheckedTimings[] = { "startup_ms", "p50_ms", "p95_ms", "p99_ms" };
+
+    struct Image {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> rgb;
+    };
+
+    bool readPpm(const std::string &path, Image &image) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            std::cerr << "[regression] can't open " << path << std::endl;
+            return false;
+        }
+        std::string magic;
+        uint32_t maxValue = 0;
+        file >> magic >> image.width >> image.height >> maxValue;
+        file.get(); // the single whitespace before the pixels
+        if (!file || magic != "P6" || maxValue != 255) {
+            std::cerr << "[regression] " << path << " is not an 8-bit binary ppm" << std::endl;
+            return false;
+        }
+        image.rgb.resize((size_t)image.width * image.height * 3);
+        file.read((char *)image.rgb.data(), image.rgb.size());
+        if (!file) {
+            std::cerr << "[regression] " << path << " is truncated" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool referenceExists(const std::string &path) {
+        if (std::ifstream(path)) {
+            return true;
+        }
+        std::cout << "[regression] no reference at " << path << "; record one with -DUPDATE_REGRESSION_REFERENCES=ON" << std::endl;
+        return false;
+    }
+
+    bool copyFile(const std::string &from, const std::string &to) {
+        std::ifstream in(from, std::ios::binary);
+        std::ofstream out(to, std::ios::binary);
+        out << in.rdbuf();
+        if (!in || !out) {
+            std::cerr << "[regression] can't copy " << from << " to " << to << std::endl;
+            return false;
+        }
+        std::cout << "[regression] recorded " << to << std::endl;
+        return true;
+    }
+
+    // sorted, so the last one is the newest frame
+    std::vector<std::string> capturedFrames(const std::string &directory) {
+        std::vector<std::string> frames;
+        DIR *dir = opendir(directory.c_str());
+        if (dir == nullptr) {
+            return frames;
+        }
+        while (dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 6, "frame_") == 0 && name.size() > 4 && name.compare(name.size() - 4, 4, ".ppm") == 0) {
+                frames.push_back(directory + "/" + name);
+            }
+        }
+        closedir(dir);
+        std::sort(frames.begin(), frames.end());
+        return frames;
+    }
+
+    int checkImages(const std::string &directory, const std::string &goldenPath, int tolerance, double maxDiffering, bool update) {
+        std::vector<std::string> frames = capturedFrames(directory);
+        if (frames.empty()) {
+            std::cerr << "[regression] no ppm frames captured in " << directory << std::endl;
+            return 1;
+        }
+        if (update) {
+            return copyFile(frames.back(), goldenPath) ? 0 : 1;
+        }
+
+        if (!referenceExists(goldenPath)) {
+            return kMissingReference;
+        }
+        Image golden;
+        if (!readPpm(goldenPath, golden)) {
+            return 1;
+        }
+
+        int failures = 0;
+        for (const std::string &path : frames) {
+            Image frame;
+            if (!readPpm(path, frame)) {
+                ++failures;
+                continue;
+            }
+            if (frame.width != golden.width || frame.height != golden.height) {
+                std::cerr << "[regression] " << path << " is " << frame.width << "x" << frame.height
+                          << ", golden is " << golden.width << "x" << golden.height << std::endl;
+                ++failures;
+                continue;
+            }
+            size_t differing = 0;
+            int maxDelta = 0;
+            for (size_t pixel = 0; pixel < frame.rgb.size(); pixel += 3) {
+                int delta = 0;
+                for (size_t channel = 0; channel < 3; ++channel) {
+                    delta = std::max(delta, std::abs((int)frame.rgb[pixel + channel] - (int)golden.rgb[pixel + channel]));
+                }
+                maxDelta = std::max(maxDelta, delta);
+                if (delta > tolerance) {
+                    ++differing;
+                }
+            }
+            const double fraction = (double)differing / ((size_t)frame.width * frame.height);
+            if (fraction > maxDiffering) {
+                std::cerr << "[regression] " << path << ": " << differing << " pixels differ by more than " << tolerance
+                          << " (max " << maxDelta << "), allowed fraction " << maxDiffering << std::endl;
+                ++failures;
+            }
+        }
+        std::cout << "[regression] " << frames.size() - failures << " of " << frames.size() << " frames match " << goldenPath << std::endl;
+        return failures == 0 ? 0 : 1;
+    }
+
+    bool readTimings(const std::string &path, std::map<std::string, double> &timings) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "[regression] can't open " << path << std::endl;
+            return false;
+        }
+        std::string name;
+        double value = 0.0;
+        while (file >> name >> value) {
+            timings[name] = value;
+        }
+        return true;
+    }
+
+    int checkStats(const std::string &statsPath, const std::string &baselinePath, double maxRatio, bool update) {
+        std::map<std::string, double> stats;
+        if (!readTimings(statsPath, stats)) {
+            return 1;
+        }
+        if (update) {
+            return copyFile(statsPath, baselinePath) ? 0 : 1;
+        }
+
+        if (!referenceExists(baselinePath)) {
+            return kMissingReference;
+        }
+        std::map<std::string, double> baseline;
+        if (!readTimings(baselinePath, baseline)) {
+            return 1;
+        }
+
+        int failures = 0;
+        for (const char *name : kCheckedTimings) {
+            auto measured = stats.find(name);
+            auto reference = baseline.find(name);
+            if (measured == stats.end() || reference == baseline.end()) {
+                std::cerr << "[regression] " << name << " missing from " << (measured == stats.end() ? statsPath : baselinePath) << std::endl;
+                ++failures;
+                continue;
+            }
+            const double limit = reference->second * maxRatio;
+            const bool regressed = measured->second > limit;
+            (regressed ? std::cerr : std::cout) << "[regression] " << name << " " << measured->second << " ms, baseline "
+                                                << reference->second << " ms, limit " << limit << " ms" << std::endl;
+            if (regressed) {
+                ++failures;
+            }
+        }
+        return failures == 0 ? 0 : 1;
+    }
+
+    int usage() {
+        std::cerr << "usage: RegressionCheck image <capture directory> <golden.ppm> <channel tolerance> <max differing fraction> [--update]\n"
+                  << "       RegressionCheck stats <stats file> <baseline file> <max ratio> [--update]" << std::endl;
+        return 2;
+    }
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc < 2) {
+        return usage();
+    }
+    const bool update = strcmp(argv[argc - 1], "--update") == 0;
+    const int arguments = update ? argc - 1 : argc;
+
+    if (strcmp(argv[1], "image") == 0 && arguments == 6) {
+        return checkImages(argv[2], argv[3], atoi(argv[4]), atof(argv[5]), update);
+    }
+    if (strcmp(argv[1], "stats") == 0 && arguments == 5) {
+        return checkStats(argv[2], argv[3], atof(argv[4]), update);
+    }
+    return usage();
+}
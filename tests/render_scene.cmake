@@ -0,0 +1,33 @@
+# Renders a fixed number of frames headlessly into OUTPUT, either capturing
+# every frame as ppm or timing the run with --stats. Timed runs capture
+# nothing and don't wait for vsync, so they measure the renderer alone.
+#   cmake -DRENDERER=<HelloWorld> -DOUTPUT=<directory> -DFRAMES=<count> -DMODE=capture|time [-DICD=<icd.json>] -P render_scene.cmake
+
+file(REMOVE_RECURSE "${OUTPUT}")
+file(MAKE_DIRECTORY "${OUTPUT}")
+
+# e.g. lavapipe or SwiftShader, so the results don't depend on the machine's GPU
+if(ICD)
+    set(ENV{VK_ICD_FILENAMES} "${ICD}")
+endif()
+# the renderer asks for full loader logging unless told otherwise
+if(NOT DEFINED ENV{VK_LOADER_DEBUG})
+    set(ENV{VK_LOADER_DEBUG} "error")
+endif()
+
+if(MODE STREQUAL "capture")
+    file(MAKE_DIRECTORY "${OUTPUT}/frames")
+    set(ModeArguments --capture "${OUTPUT}/frames" --capture-format ppm)
+elseif(MODE STREQUAL "time")
+    set(ModeArguments --vsync off --stats "${OUTPUT}/stats.txt")
+else()
+    message(FATAL_ERROR "MODE must be capture or time, not '${MODE}'")
+endif()
+
+execute_process(
+    COMMAND "${RENDERER}" --headless on --frames ${FRAMES} ${ModeArguments}
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${RENDERER} exited with ${result}")
+endif()